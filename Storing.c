@@ -45,6 +45,8 @@ team_t team = {
 #define DSIZE   8 /* Double word size */
 #define CHUNKSIZE   (1 << 12) /* Extends the heap by this size */
 
+#define MAX(x, y)   ((x) > (y) ? (x) : (y))
+
 /* Packs a size and allocated bit into a word */
 #define PACK(size, alloc)   ((size) | (alloc)) 
 
@@ -108,15 +110,25 @@ int mm_init(void)
 }
 
 /* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+ * mm_malloc - Allocate a block from the best-fitting free block, extending
+ *     the heap when nothing fits. Always allocate a block whose size is a
+ *     multiple of the alignment.
  */
 void *mm_malloc(size_t size)
 {
     void *bp;
+    size_t newsize;
+
+    if (size == 0) {
+        return NULL;
+    }
 
-    /* Align memory block size */
-    int newsize = ALIGN(size + SIZE_T_SIZE);
+    /* Align memory block size, including room for the header and footer */
+    if (size <= DSIZE) {
+        newsize = 2 * DSIZE;
+    } else {
+        newsize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
+    }
     
     /* Best fit search for request memory size.
      * Case 1: best_fit() finds a space to add 
@@ -128,30 +140,27 @@ void *mm_malloc(size_t size)
         return (bp);
     } 
     /* we need to extend the size */
-    bp = mem_sbrk(newsize);
-    if (bp == (void *)-1){
+    bp = extend_heap(MAX(newsize, CHUNKSIZE) / WSIZE);
+    if (bp == NULL){
         return NULL;
-    } else {
-        *(size_t *)bp = size;
-        return (void *)((char *)bp + SIZE_T_SIZE);
     }
-
-    // int newsize = ALIGN(size + SIZE_T_SIZE);
-    // void *p = mem_sbrk(newsize);
-    // if (p == (void *)-1)
-    // return NULL;
-    // else {
-    //     *(size_t *)p = size;
-    //     return (void *)((char *)p + SIZE_T_SIZE);
-    // }
+    split(bp, newsize);
+    return bp;
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - Marks the block as free and merges it with free neighbors.
  */
 void mm_free(void *ptr)
 {
+    if (ptr == NULL) {
+        return;
+    }
 
+    size_t size = GET_SIZE(HDRP(ptr));
+    PUT(HDRP(ptr), PACK(size, 0));
+    PUT(FTRP(ptr), PACK(size, 0));
+    coalesce(ptr);
 }
 
 /*
@@ -163,10 +172,17 @@ void *mm_realloc(void *ptr, size_t size)
     void *newptr;
     size_t copySize;
     
+    if (oldptr == NULL)
+      return mm_malloc(size);
+    if (size == 0) {
+      mm_free(oldptr);
+      return NULL;
+    }
+
     newptr = mm_malloc(size);
     if (newptr == NULL)
       return NULL;
-    copySize = *(size_t *)((char *)oldptr - SIZE_T_SIZE);
+    copySize = GET_SIZE(HDRP(oldptr)) - DSIZE;
     if (size < copySize)
       copySize = size;
     memcpy(newptr, oldptr, copySize);
@@ -234,48 +250,53 @@ static void *extend_heap(size_t words)
 }
 
 /*
- *
+ * best_fit - finds the smallest free block that can hold size bytes,
+ * stopping at the epilogue header (size 0). Returns NULL if none fits.
  */
 static void *best_fit(size_t size){
-    void *bp = heap_listp;
+    void *bp;
     void *best = NULL;
-    size_t size_difference, smallest_difference;
+    size_t size_difference, smallest_difference = 0;
 
-    while (bp != NULL){
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < size) {
+            continue;
+        }
         size_difference = GET_SIZE(HDRP(bp)) - size;
         /* we found an exact fit and its free */
-        if( size_difference == 0 && GET_ALLOC(bp) == 0 ){
+        if( size_difference == 0 ){
             return bp;
-        /* the request size can fit */
-        } else if( size_difference  > 0 && GET_ALLOC(bp) == 0 ){
-            if( best == NULL ){
-                best = bp;
-                smallest_difference = size_difference;
-            }
-            /* it is closer than the other value & accounts for a tie */
-            else if ( size_difference < smallest_difference && size_difference != smallest_difference){ 
-                best = bp;
-                smallest_difference = size_difference;
-            }
-
         }
-        bp = NEXT_BLKP(bp); // [Not sure if this is how you move to the next pointer]
+        /* it is closer than the other value & accounts for a tie */
+        if( best == NULL || size_difference < smallest_difference ){
+            best = bp;
+            smallest_difference = size_difference;
+        }
     }
-    return bp;
+    return best;
  }
 
+/*
+ * split - places a newsize allocation at the start of free block bp and
+ * returns the remainder to the heap if it can hold a minimum-sized block.
+ */
 static void split(void *bp, size_t newsize)
 {
-    size_t leftover = GET_SIZE(bp) - newsize; 
+    size_t leftover = GET_SIZE(HDRP(bp)) - newsize; 
+
+    if (leftover < 2 * DSIZE){
+        /* Remainder is too small to be a block: hand out the whole thing */
+        PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
+        PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
+        return;
+    }
 
     /* Update size of current block */
     PUT(HDRP(bp), PACK(newsize, 1));
     PUT(FTRP(bp), PACK(newsize, 1));
 
-    if (leftover > 0){
-        bp = NEXT_BLKP(bp);
-        /* Place information in new block */
-        PUT(HDRP(bp), PACK(leftover, 0));
-        PUT(FTRP(bp), PACK(leftover, 0));
-    }
-}
\ No newline at end of file
+    bp = NEXT_BLKP(bp);
+    /* Place information in new block */
+    PUT(HDRP(bp), PACK(leftover, 0));
+    PUT(FTRP(bp), PACK(leftover, 0));
+}
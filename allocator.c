@@ -14,605 +14,4961 @@
  * (Everything after this point will use your custom allocator -- be careful!)
  */
 
+/* for the writer-preferring rwlock initializer */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <linux/futex.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include "allocator.h"
 #include "logger.h"
 
+/** Maximum number of distinct malloc_name() tags; later names share the last tag */
+#define MAX_TAGS 128
+
+/** A thread folds its pending bytes for a tag into the global count past this */
+#define TAG_FLUSH_BYTES (64 * 1024)
+
+/** Block ids a thread takes from g_allocations at a time (see populate()) */
+#define ALLOC_ID_BATCH 64
+
+/** Reader slots of list_lock; threads share a slot when there are more of them */
+#define LIST_SLOTS 64
+
+/** Default size of an arena's first region, and the cap on later ones */
+#define ARENA_MIN_REGION (64 * 1024)
+#define ARENA_MAX_REGION (4 * 1024 * 1024)
+
+/** Alignment of arena_malloc() allocations: enough for any type */
+#define ARENA_ALIGNMENT 16
+
+/** Default size of the address-space reservation (ALLOCATOR_RESERVE) */
+#define RESERVE_DEFAULT ((size_t) 64 * 1024 * 1024 * 1024)
+
+/** Number of released ranges the reservation keeps track of */
+#define RESERVE_HOLES 64
+
+/** Identifies a persistent heap file ("PHEAP002") and its blocks */
+#define PHEAP_MAGIC 0x3230305041454850ULL
+#define PHEAP_BLOCK_MAGIC 0x6b636f6c42504850ULL
+
+/** Alignment of persistent heap payloads */
+#define PHEAP_ALIGNMENT 16
+
+/**
+ * Lifetime records (see life_predict()): a valid bit, the predicted class,
+ * the call site's slot and the allocation clock when the block was handed out
+ */
+#define LIFE_VALID (1ULL << 63)
+#define LIFE_LONG (1ULL << 62)
+#define LIFE_SITE_BITS 12
+#define LIFE_CLOCK_BITS 40
+#define LIFE_CLOCK_MASK ((1ULL << LIFE_CLOCK_BITS) - 1)
+
+/** Allocations a block must outlive to count as long-lived, by default */
+#define LIFE_THRESHOLD_DEFAULT 16384
+
+/**
+ * Makes the caller of the current (public) function the call site of the
+ * allocation it is about to make, so calloc() and friends are not all
+ * attributed to themselves. malloc_block() consumes it.
+ */
+#define LIFE_CALLER() do { \
+        if (life_caller == NULL) { \
+            life_caller = __builtin_return_address(0); \
+        } \
+    } while (0)
+
+/** Largest default and smallest size of a streaming fill or copy (see bulk_fill()) */
+#define NT_THRESHOLD_DEFAULT (4 * 1024 * 1024)
+#define NT_THRESHOLD_MIN 4096
+
+/** Default number of spins before a contended alloc_lock parks (ALLOCATOR_LOCK_SPIN) */
+#define LOCK_SPINS 100
+
+/*
+ * Latency histograms (see lat_record()) are compiled in with LATENCY=1. Each
+ * power of two of nanoseconds is split into LAT_SUB linear buckets, so a
+ * recorded value is off by at most 1/LAT_SUB (12.5%).
+ */
+#ifndef LATENCY
+#define LATENCY 0
+#endif
+#define LAT_SUB_BITS 3
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS 40 /*!< Longer latencies (over 18 minutes) share the last bucket */
+#define LAT_BUCKETS ((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB)
+
+#if LATENCY
+#define LAT_START(t) unsigned long t = lat_now()
+#define LAT_END(hist, t) lat_record((hist), lat_now() - (t))
+#else
+#define LAT_START(t) do { } while (0)
+#define LAT_END(hist, t) do { } while (0)
+#endif
+
+/**
+ * Adds to the calling thread's share of an alloc_stats counter (see
+ * stat_counters). A thread that could not get counters of its own adds to
+ * g_stats atomically.
+ */
+#define STAT_ADD(field, n) do { \
+        struct stat_counters *stats_ = stat_mine(); \
+        if (stats_ == NULL) { \
+            __atomic_fetch_add(&g_stats.field, (n), __ATOMIC_RELAXED); \
+        } else { \
+            __atomic_store_n(&stats_->counts.field, stats_->counts.field + (n), \
+                    __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
 #define MEM_SIZE sizeof(struct mem_block); 
 
 static struct mem_block *g_head = NULL; /*!< Start (head) of our linked list */
-static unsigned long g_allocations = 0; /*!< Allocation counter */
+static struct mem_block *g_rover = NULL; /*!< Where the last next_fit search ended */
+static struct alloc_stats g_stats = { 0 }; /*!< Counters of threads without stat_counters */
+static unsigned long g_allocations = 0; /*!< Next batch of block ids */
+static __thread unsigned long my_next_id = 0; /*!< This thread's batch of block ids */
+static __thread unsigned long my_end_id = 0;
 static size_t page_sz = 4096;
-static bool is_scribbling = false;
+static __thread bool is_scribbling = false;
+static int is_debugging = -1; /*!< ALLOCATOR_DEBUG, read on first use (-1: not read yet) */
+
+/**
+ * Adaptive spin-then-park lock. The critical sections it protects are a few
+ * hundred instructions long, so a waiter first spins for a while (the holder
+ * is usually about to release it) and only then sleeps on a futex. state is 0
+ * when unlocked, 1 when locked and 2 when locked with (possibly) sleeping
+ * waiters.
+ */
+struct alloc_lock {
+    int state;
+#if LATENCY
+    unsigned long held_since; /*!< When the current holder acquired it */
+#endif
+};
+
+#define ALLOC_LOCK_INITIALIZER { 0 }
+
+/**
+ * One reader slot of list_lock (see list_lock_shared()), on a cache line of
+ * its own so that readers in different slots share nothing.
+ */
+struct list_slot {
+    int readers; /*!< Threads holding list_lock shared through this slot */
+} __attribute__((aligned(64)));
+
+#if LATENCY
+/** What the latency histograms measure; see lat_names for their labels. */
+enum lat_hist {
+    LAT_MALLOC,    /*!< A whole malloc() call */
+    LAT_FREE,      /*!< A whole free() call */
+    LAT_REALLOC,   /*!< A whole realloc() call */
+    LAT_LOCK_WAIT, /*!< Waiting for a contended lock */
+    LAT_LOCK_HOLD, /*!< Holding a region (or other alloc_lock) lock */
+    LAT_SEARCH,    /*!< An FSM search plus the split, in reuse() */
+    LAT_MMAP,      /*!< Mapping or committing a region in request() */
+    LAT_MUNMAP,    /*!< Unmapping or decommitting a region */
+    LAT_PURGE,     /*!< A purge_heap() sweep */
+    LAT_COUNT
+};
+
+/**
+ * One thread's latency histograms. Only the owning thread writes them, so
+ * recording needs no lock; readers add up every thread's counts.
+ */
+struct lat_counters {
+    struct lat_counters *next;                  /*!< Next thread's histograms */
+    struct lat_counters *spare;                 /*!< Next unowned histograms */
+    unsigned long counts[LAT_COUNT][LAT_BUCKETS]; /*!< Samples per bucket */
+};
+#endif
+
+/**
+ * Out-of-line metadata for one region: the region's blocks in list (and
+ * address) order, kept as a structure of arrays. free_sz[i] is the reusable
+ * space (size - usage) of blocks[i], saturated to 32 bits, so the FSM searches
+ * scan a small packed array instead of chasing ->next through the headers.
+ */
+struct region_meta {
+    struct alloc_lock lock;    /*!< Protects the region's blocks and these arrays */
+    size_t count;              /*!< Number of blocks in the region */
+    size_t capacity;           /*!< Number of entries the arrays can hold */
+    struct mem_block **blocks; /*!< Block headers, in list order */
+    uint32_t *free_sz;         /*!< Reusable space of each block */
+    bool pinned;               /*!< Prewarmed: its free pages are never purged */
+    bool growable;             /*!< Committed from the reservation and not oversized */
+    bool long_lived;           /*!< Holds allocations predicted to be long-lived */
+    uint64_t life;             /*!< Lifetime record of the region's first block */
+};
+
+/**
+ * A released range of the reservation below its top, reused by later
+ * regions (see reserve_take()).
+ */
+struct reserve_hole {
+    char *start;
+    size_t len;
+};
+
+/** Signature of the free-space search kernels (see meta_find()). */
+typedef size_t (*find_kernel)(const uint32_t *free_sz, size_t from, size_t to, uint32_t size);
+
+/** Signatures of the streaming fill and copy kernels (see bulk_fill()). */
+typedef void (*fill_kernel)(void *dst, int c, size_t len);
+typedef void (*copy_kernel)(void *dst, const void *src, size_t len);
+
+/**
+ * Per-thread tag counters (see tag_account()). Each thread only ever writes
+ * its own block, so updates are plain stores; readers merge all blocks. When
+ * a thread exits its block is kept on the list and handed to the next new
+ * thread, counts and all.
+ */
+struct tag_counters {
+    struct tag_counters *next;          /*!< Next thread's counters */
+    struct tag_counters *spare;         /*!< Next block left by an exited thread */
+    long bytes[MAX_TAGS];               /*!< Live bytes not yet folded into g_tags */
+    long allocs[MAX_TAGS];              /*!< Live allocations */
+    unsigned long total[MAX_TAGS];      /*!< Allocations ever made */
+};
+
+/**
+ * One thread's share of the alloc_stats counters (see STAT_ADD()). Like the
+ * tag counters, each thread only writes its own block, get_stats() adds all
+ * of them up, and an exited thread's block goes to the next new thread.
+ */
+struct stat_counters {
+    struct stat_counters *next;         /*!< Next thread's counters */
+    struct stat_counters *spare;        /*!< Next block left by an exited thread */
+    struct alloc_stats counts;          /*!< Only the counter fields are used */
+};
+
+/**
+ * Global state of one interned tag.
+ */
+struct tag_info {
+    char name[32];   /*!< Interned malloc_name() name */
+    long live_bytes; /*!< Live bytes folded in from the threads */
+    long peak_bytes; /*!< Highest live_bytes seen when folding or reading */
+};
+
+/**
+ * Header at the start of every region mapped for an arena (see arena_malloc()).
+ * Arena regions are not part of the block list; their allocations carry no
+ * headers of their own.
+ */
+struct arena_chunk {
+    struct arena_chunk *next; /*!< Next region of the same arena */
+    size_t size;              /*!< Size of the mapping */
+};
+
+/**
+ * An arena: a chain of regions handed out with a bump pointer. The arena
+ * lives in its first region, right behind that region's header.
+ */
+struct arena {
+    struct arena_chunk *first; /*!< First region; holds this struct */
+    struct arena_chunk *curr;  /*!< Region allocations are bumped from */
+    char *bump;                /*!< Next free byte in curr */
+    char *end;                 /*!< End of curr */
+    size_t next_size;          /*!< Size of the next region to map */
+};
+
+/**
+ * Header at the start of a persistent or shared heap. Everything inside the
+ * heap refers to other parts of it by offset from this header, never by
+ * address, so it can be mapped anywhere, and at a different address in every
+ * process that shares it. Offset 0 stands for NULL.
+ */
+struct pheap_header {
+    uint64_t magic;       /*!< PHEAP_MAGIC, written last by pheap_format() */
+    uint64_t size;        /*!< Size of the heap */
+    uint64_t root;        /*!< Offset of the root object, set by pheap_set_root() */
+    uint64_t first;       /*!< Offset of the first block */
+    pthread_mutex_t lock; /*!< Process-shared and robust; protects the blocks */
+};
+
+/**
+ * Header of one block in a persistent heap. Like struct mem_block, usage
+ * counts the header and is 0 when the block is free, and the blocks tile the
+ * file in address order.
+ */
+struct pheap_block {
+    uint64_t size;  /*!< Size of the block, including this header */
+    uint64_t usage; /*!< Space used; 0 if the block is free */
+    uint64_t next;  /*!< Offset of the next block, 0 for the last one */
+    uint64_t magic; /*!< PHEAP_BLOCK_MAGIC, checked by pheap_free() */
+};
+
+/**
+ * An open persistent or shared heap: its mapping in this process. The lock
+ * lives in the heap itself (struct pheap_header), so that every process
+ * mapping it takes the same one.
+ */
+struct pheap {
+    char *base;  /*!< Where the heap is mapped */
+    size_t size; /*!< Size of the mapping */
+    int fd;      /*!< The heap file (flock()ed), shm object or memfd */
+};
+
+/**
+ * Metadata for one slot of the guarded sample pool (see guarded_malloc()).
+ */
+struct guard_slot {
+    void *caller;           /*!< Return address of the malloc() call */
+    unsigned long alloc_id; /*!< alloc_id of the block in this slot */
+    size_t size;            /*!< Requested size */
+    bool in_use;            /*!< A live allocation occupies the slot */
+    bool freed;             /*!< The slot held an allocation that was freed */
+};
+
+/* Sampled guard-page allocations: see guarded_malloc() */
+static int sample_configured = 0; /*!< 0: not read yet, 1: on, -1: off */
+static unsigned long sample_rate = 0; /*!< Sample roughly one in this many allocations */
+static size_t guard_num_slots = 64;
+static char *guard_pool = NULL; /*!< [guard][slot][guard][slot]...[guard] */
+static size_t guard_pool_size = 0;
+static struct guard_slot *guard_slots = NULL;
+static size_t guard_next_slot = 0;
+static struct sigaction guard_old_action;
+static __thread unsigned long sample_countdown = 0;
+static __thread unsigned long sample_seed = 0;
+
+/* Region metadata storage: see meta_alloc() */
+#define META_CHUNK_SIZE (1024 * 1024)
+#define META_MIN_CLASS 6
+static void *meta_free_lists[sizeof(size_t) * CHAR_BIT]; /*!< Free chunks by power-of-two class */
+static char *meta_bump = NULL; /*!< Next unused byte of the current metadata chunk */
+static char *meta_bump_end = NULL;
+static pthread_once_t find_once = PTHREAD_ONCE_INIT;
+static find_kernel meta_find_kernel = NULL; /*!< Chosen by select_find_kernel() */
+
+/* Bulk fills and copies: see bulk_fill() */
+static pthread_once_t bulk_once = PTHREAD_ONCE_INIT;
+static fill_kernel nt_fill = NULL; /*!< Chosen by select_bulk_kernels(); NULL: memset() only */
+static copy_kernel nt_copy = NULL;
+static size_t nt_threshold = SIZE_MAX; /*!< Fills and copies this big stream */
+
+/* Per-tag accounting: see tag_account() */
+static struct tag_info g_tags[MAX_TAGS] = { { "(untagged)", 0, 0 } };
+static unsigned int g_num_tags = 1; /*!< Tag 0 is reserved for untagged blocks */
+static struct tag_counters *g_tag_threads = NULL; /*!< Every thread's counters */
+static struct tag_counters g_tag_base; /*!< Counters for threads that have none yet */
+static struct tag_counters *g_tag_spare = NULL; /*!< Counters of exited threads */
+static __thread struct tag_counters *my_tags = NULL;
+static pthread_key_t tag_key; /*!< Hands my_tags back when its thread exits */
+static pthread_once_t tag_once = PTHREAD_ONCE_INIT;
+
+/* Per-thread counters: see STAT_ADD() */
+static struct stat_counters *g_stat_threads = NULL; /*!< Every thread's counters */
+static struct stat_counters *g_stat_spare = NULL; /*!< Counters of exited threads */
+static __thread struct stat_counters *my_stats = NULL;
+static pthread_key_t stat_key; /*!< Hands my_stats back when its thread exits */
+static pthread_once_t stat_once = PTHREAD_ONCE_INIT;
+
+#if LATENCY
+/* Latency histograms: see lat_record() */
+static const char *lat_names[LAT_COUNT] = {
+    "malloc", "free", "realloc", "lock wait", "lock hold",
+    "search", "mmap", "munmap", "purge"
+};
+static struct lat_counters *g_lat_threads = NULL; /*!< Every thread's histograms */
+static struct lat_counters *g_lat_spare = NULL; /*!< Histograms of exited threads, emptied */
+static struct lat_counters g_lat_exited; /*!< Samples of exited threads */
+static pthread_once_t lat_once = PTHREAD_ONCE_INIT;
+static pthread_key_t lat_key; /*!< Hands my_lat back when its thread exits */
+static pthread_mutex_t lat_mutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protects the fields above */
+static __thread struct lat_counters *my_lat = NULL;
+#endif
+
+/* Geometric region growth: see grow_region_size() */
+static bool region_configured = false;
+static size_t region_min = 64 * 1024; /*!< Size of the first grown region (0 disables growth) */
+static size_t region_max = 4 * 1024 * 1024; /*!< Regions stop growing at this size */
+static size_t g_next_region[2] = { 0, 0 }; /*!< Size of the next grown region, per lifetime class */
+
+/* Page purging: see purge_heap() */
+static bool purge_configured = false;
+static int purge_advice = MADV_DONTNEED; /*!< Advice passed to madvise(), or -1 when purging is off */
+static unsigned long purge_decay_ms = 1000; /*!< How long freed pages stay resident */
+static unsigned long g_last_purge = 0; /*!< When the heap was last swept for purgeable pages */
+
+/* Address-space reservation: see reserve_init() */
+static struct alloc_lock reserve_lock = ALLOC_LOCK_INITIALIZER; /*!< Protects the fields below */
+static bool reserve_configured = false;
+static char *reserve_start = NULL; /*!< PROT_NONE range regions are committed from */
+static char *reserve_end = NULL;
+static char *reserve_top = NULL; /*!< Nothing at or above this has been committed */
+static struct reserve_hole reserve_holes[RESERVE_HOLES]; /*!< Released ranges, by address */
+static size_t reserve_nholes = 0;
+
+/* Heap limits: see limit_region_size() */
+static pthread_once_t limit_once = PTHREAD_ONCE_INIT;
+static size_t soft_limit = 0; /*!< Reclaim before mapping past this (0: no limit) */
+static size_t hard_limit = 0; /*!< Never map past this (0: no limit) */
+static size_t g_mapped = 0; /*!< Bytes currently mapped with request() */
+static pressure_callback pressure_cb = NULL; /*!< Set by malloc_set_pressure_callback() */
+static void *pressure_arg = NULL;
+static __thread bool pressure_pending = false; /*!< This thread crossed the soft limit */
+static __thread bool in_pressure_cb = false;
+
+/* Startup prewarming: see prewarm_heap() */
+static int map_populate = 0; /*!< MAP_POPULATE when ALLOCATOR_POPULATE=1 */
+
+/* Lifetime-aware placement: see life_predict() */
+static pthread_once_t life_once = PTHREAD_ONCE_INIT;
+static bool life_configured = false;
+static bool life_enabled = false; /*!< ALLOCATOR_LIFETIME=1 */
+static unsigned long life_threshold = LIFE_THRESHOLD_DEFAULT;
+static unsigned long g_life_clock = 0; /*!< Allocations made while predicting */
+static uint8_t life_sites[1 << LIFE_SITE_BITS]; /*!< 2-bit counters; 2 and up predict long-lived */
+static __thread bool life_long = false; /*!< Class of the allocation being placed */
+static __thread void *life_caller = NULL; /*!< Set by LIFE_CALLER() */
+
+/*
+ * Locking. The region list (g_head, the links between regions, g_rover and
+ * region growth) is protected by list_lock. Operations confined to one
+ * region (malloc() carving a block, free(), realloc() in place) hold it
+ * shared plus that region's own lock, so they only contend with each other
+ * when they touch the same region. Anything that adds or removes regions or
+ * walks the whole heap (add_region(), unmapping, purging, stats) holds it
+ * exclusively and needs no region locks. list_lock is not one lock word but
+ * a writer flag plus per-thread reader slots (see list_lock_shared()). Lock order: list_lock, then a region
+ * lock, then meta_lock / tag_lock / stat_lock. guard_lock covers the sampled
+ * pool.
+ */
+static struct list_slot list_slots[LIST_SLOTS]; /*!< list_lock readers */
+static int list_writer = 0; /*!< list_lock: 1 held exclusively, 2 and readers are waiting */
+static pthread_mutex_t list_writer_mutex = PTHREAD_MUTEX_INITIALIZER; /*!< Queues the writers */
+static unsigned int list_next_slot = 0; /*!< Slot of the next thread to read */
+static __thread struct list_slot *my_list_slot = NULL;
+static struct alloc_lock meta_lock = ALLOC_LOCK_INITIALIZER; /*!< Metadata storage */
+static struct alloc_lock tag_lock = ALLOC_LOCK_INITIALIZER; /*!< Tag table and thread registry */
+static struct alloc_lock stat_lock = ALLOC_LOCK_INITIALIZER; /*!< Stat counter registry */
+static struct alloc_lock guard_lock = ALLOC_LOCK_INITIALIZER; /*!< Guarded sample pool */
+static int lock_spins = -1; /*!< ALLOCATOR_LOCK_SPIN, read on first contention */
+static pthread_once_t purge_once = PTHREAD_ONCE_INIT;
+
+/* Deferred unmapping: see defer_unmap() */
+static struct mem_block *unmap_queue = NULL; /*!< Unlinked regions, chained through ->next */
+static pthread_mutex_t unmap_mutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protects unmap_queue */
+static pthread_cond_t unmap_cond = PTHREAD_COND_INITIALIZER; /*!< Wakes the reclaimer */
+static int reclaimer_configured = 0; /*!< 0: not yet, 1: being started, 2: done */
+static bool reclaimer_running = false; /*!< ALLOCATOR_RECLAIMER=1 and the thread started */
+
+/**
+ * Returns the current CLOCK_MONOTONIC time in milliseconds.
+ *
+ * @param void
+ */
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+/**
+ * Lets the other hyperthread run while spinning.
+ *
+ * @param void
+ */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#if LATENCY
+/**
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds. This goes through
+ * the vDSO, so it does not enter the kernel.
+ *
+ * @param void
+ */
+static unsigned long lat_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/**
+ * Returns the histogram bucket for a latency of ns nanoseconds: values below
+ * LAT_SUB get a bucket each, and every power of two above that is split into
+ * LAT_SUB equal buckets.
+ *
+ * @param ns
+ */
+static size_t lat_bucket(unsigned long ns)
+{
+    if (ns >= 1UL << LAT_MAX_BITS) {
+        ns = (1UL << LAT_MAX_BITS) - 1;
+    }
+    if (ns < LAT_SUB) {
+        return ns;
+    }
+    int shift = (int) (sizeof(long) * CHAR_BIT - 1) - __builtin_clzl(ns) - LAT_SUB_BITS;
+    return (shift + 1) * LAT_SUB + ((ns >> shift) & (LAT_SUB - 1));
+}
+
+/**
+ * Returns the largest latency that falls into a histogram bucket; this is
+ * what the percentiles report.
+ *
+ * @param bucket
+ */
+static unsigned long lat_bucket_max(size_t bucket)
+{
+    if (bucket < LAT_SUB) {
+        return bucket;
+    }
+    int shift = bucket / LAT_SUB - 1;
+    unsigned long low = (unsigned long) (LAT_SUB + bucket % LAT_SUB) << shift;
+    return low + (1UL << shift) - 1;
+}
+
+/**
+ * Thread exit destructor of lat_key: folds the thread's samples into
+ * g_lat_exited and leaves its emptied histograms for the next thread that
+ * records, so the registry is no larger than the most threads ever alive at
+ * once.
+ *
+ * @param arg
+ */
+static void lat_release_thread(void *arg)
+{
+    struct lat_counters *counters = arg;
+    my_lat = NULL;
+    pthread_mutex_lock(&lat_mutex);
+    for (int hist = 0; hist < LAT_COUNT; ++hist) {
+        for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+            g_lat_exited.counts[hist][i] += counters->counts[hist][i];
+            counters->counts[hist][i] = 0;
+        }
+    }
+    counters->spare = g_lat_spare;
+    g_lat_spare = counters;
+    pthread_mutex_unlock(&lat_mutex);
+}
+
+/**
+ * Creates lat_key; run once through lat_once.
+ *
+ * @param void
+ */
+static void lat_init(void)
+{
+    pthread_key_create(&lat_key, lat_release_thread);
+}
+
+/**
+ * Gives the calling thread its own histograms: an exited thread's, or a new
+ * block mapped directly with mmap(). lat_mutex is a plain pthread mutex, since
+ * our own locks record latencies themselves.
+ *
+ * @param void
+ */
+static struct lat_counters *lat_register_thread(void)
+{
+    pthread_once(&lat_once, lat_init);
+
+    pthread_mutex_lock(&lat_mutex);
+    struct lat_counters *counters = g_lat_spare;
+    if (counters != NULL) {
+        g_lat_spare = counters->spare;
+    }
+    pthread_mutex_unlock(&lat_mutex);
+
+    if (counters == NULL) {
+        counters = mmap(NULL, sizeof(struct lat_counters), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (counters == MAP_FAILED) {
+            return NULL;
+        }
+        pthread_mutex_lock(&lat_mutex);
+        counters->next = g_lat_threads;
+        g_lat_threads = counters;
+        pthread_mutex_unlock(&lat_mutex);
+    }
+    my_lat = counters;
+    pthread_setspecific(lat_key, counters);
+    return counters;
+}
+
+/**
+ * Records a latency of ns nanoseconds in the calling thread's histogram for
+ * hist. A thread's histograms are registered on its first sample (see
+ * lat_register_thread()); after that, recording takes no lock.
+ *
+ * @param hist, ns
+ */
+static void lat_record(enum lat_hist hist, unsigned long ns)
+{
+    struct lat_counters *counters = my_lat;
+    if (counters == NULL) {
+        counters = lat_register_thread();
+        if (counters == NULL) {
+            return;
+        }
+    }
+
+    unsigned long *count = &counters->counts[hist][lat_bucket(ns)];
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+#endif
+
+/**
+ * Waits for a contended alloc_lock: it is spun on ALLOCATOR_LOCK_SPIN times
+ * (default: 100; 0 parks right away), then the thread marks the lock as
+ * having waiters and sleeps in futex() until the holder wakes it.
+ *
+ * @param lock
+ */
+static void lock_contended(struct alloc_lock *lock)
+{
+    int c;
+    if (lock_spins == -1) {
+        char *spins = getenv("ALLOCATOR_LOCK_SPIN");
+        lock_spins = spins == NULL ? LOCK_SPINS : atoi(spins);
+    }
+    for (int i = 0; i < lock_spins; ++i) {
+        cpu_relax();
+        c = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+        if (c == 0 && __atomic_compare_exchange_n(&lock->state, &c, 1, false,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+
+    /* park: whoever takes the lock from here on leaves it marked contended */
+    while (__atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        syscall(SYS_futex, &lock->state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Acquires an alloc_lock. An uncontended lock costs one compare-and-swap; a
+ * contended one is handed to lock_contended().
+ *
+ * @param lock
+ */
+static void lock_acquire(struct alloc_lock *lock)
+{
+    int c = 0;
+    if (!__atomic_compare_exchange_n(&lock->state, &c, 1, false,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        LAT_START(wait_start);
+        lock_contended(lock);
+        LAT_END(LAT_LOCK_WAIT, wait_start);
+    }
+#if LATENCY
+    lock->held_since = lat_now();
+#endif
+}
+
+/**
+ * Releases an alloc_lock, waking one sleeping waiter if there may be any.
+ *
+ * @param lock
+ */
+static void lock_release(struct alloc_lock *lock)
+{
+#if LATENCY
+    lat_record(LAT_LOCK_HOLD, lat_now() - lock->held_since);
+#endif
+    if (__atomic_exchange_n(&lock->state, 0, __ATOMIC_RELEASE) == 2) {
+        syscall(SYS_futex, &lock->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Releases list_lock after list_lock_shared(), waking a writer that is
+ * waiting for this slot to drain.
+ *
+ * @param void
+ */
+static void list_unlock_shared(void)
+{
+    struct list_slot *slot = my_list_slot;
+    if (__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST) == 0
+            && __atomic_load_n(&list_writer, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, &slot->readers, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Takes list_lock shared. A pthread rwlock would make every reader write
+ * its one lock word, so all threads would bounce that cache line even when
+ * they touch different regions. Instead each thread counts itself in its
+ * own slot and then checks that no writer holds the list; writers raise
+ * list_writer first and then wait for every slot to drain, so one of the two
+ * always sees the other. A reader that finds a writer steps back and sleeps
+ * until it is done. With LATENCY=1, the time spent waiting is recorded.
+ *
+ * @param void
+ */
+static void list_lock_shared(void)
+{
+    struct list_slot *slot = my_list_slot;
+    if (slot == NULL) {
+        slot = &list_slots[__atomic_fetch_add(&list_next_slot, 1, __ATOMIC_RELAXED)
+            % LIST_SLOTS];
+        my_list_slot = slot;
+    }
+
+    for (;;) {
+        __atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&list_writer, __ATOMIC_SEQ_CST) == 0) {
+            return;
+        }
+        list_unlock_shared();
+
+        LAT_START(wait_start);
+        int w = __atomic_load_n(&list_writer, __ATOMIC_RELAXED);
+        while (w != 0) {
+            if (w == 2 || __atomic_compare_exchange_n(&list_writer, &w, 2, false,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                syscall(SYS_futex, &list_writer, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+            }
+            w = __atomic_load_n(&list_writer, __ATOMIC_RELAXED);
+        }
+        LAT_END(LAT_LOCK_WAIT, wait_start);
+    }
+}
+
+/**
+ * Takes list_lock exclusively; see list_lock_shared(). New readers are held
+ * off as soon as list_writer is raised, so a writer only waits for the
+ * readers already inside.
+ *
+ * @param void
+ */
+static void list_lock_exclusive(void)
+{
+#if LATENCY
+    unsigned long start = lat_now();
+    bool waited = false;
+    if (pthread_mutex_trylock(&list_writer_mutex) != 0) {
+        pthread_mutex_lock(&list_writer_mutex);
+        waited = true;
+    }
+#else
+    pthread_mutex_lock(&list_writer_mutex);
+#endif
+    __atomic_store_n(&list_writer, 1, __ATOMIC_SEQ_CST);
+
+    for (size_t i = 0; i < LIST_SLOTS; ++i) {
+        int readers;
+        while ((readers = __atomic_load_n(&list_slots[i].readers, __ATOMIC_SEQ_CST)) != 0) {
+            syscall(SYS_futex, &list_slots[i].readers, FUTEX_WAIT_PRIVATE, readers,
+                    NULL, NULL, 0);
+#if LATENCY
+            waited = true;
+#endif
+        }
+    }
+#if LATENCY
+    if (waited) {
+        lat_record(LAT_LOCK_WAIT, lat_now() - start);
+    }
+#endif
+}
+
+/**
+ * Releases list_lock after list_lock_exclusive() and wakes the readers that
+ * waited for it.
+ *
+ * @param void
+ */
+static void list_unlock_exclusive(void)
+{
+    if (__atomic_exchange_n(&list_writer, 0, __ATOMIC_SEQ_CST) == 2) {
+        syscall(SYS_futex, &list_writer, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+    pthread_mutex_unlock(&list_writer_mutex);
+}
+
+/**
+ * Locks the region a block belongs to, holding list_lock shared so the region
+ * cannot be unmapped meanwhile. Returns the region's metadata, or NULL for a
+ * sampled block, which lives outside the list and needs no region lock.
+ *
+ * @param block
+ */
+static struct region_meta *lock_region_of(struct mem_block *block)
+{
+    list_lock_shared();
+    struct region_meta *meta = block->region_start->meta;
+    if (meta != NULL) {
+        lock_acquire(&meta->lock);
+    }
+    return meta;
+}
+
+/**
+ * Undoes lock_region_of().
+ *
+ * @param meta
+ */
+static void unlock_region(struct region_meta *meta)
+{
+    if (meta != NULL) {
+        lock_release(&meta->lock);
+    }
+    list_unlock_shared();
+}
+
+/**
+ * A simple LOG function to LOG contents of a struct mem_block.
+ *
+ * @param block
+ */
+void print_block(struct mem_block *block){
+    LOG("\t\talloc_id: %lu\n", block->alloc_id);
+    LOG("\t\tblock_name: %s\n", block->name);
+    LOG("\t\tblock_size: %zu\n", block->size);
+    LOG("\t\tblock_usage: %zu\n", block->usage); 
+}
+
+/**
+ * Faults in the pages of [start, start + len) so later writes to them do not
+ * trap. Uses MADV_POPULATE_WRITE where the kernel has it and touches one byte
+ * per page otherwise.
+ *
+ * @param start, len
+ */
+static void prefault(void *start, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(start, len, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    for (size_t off = 0; off < len; off += page_sz) {
+        ((volatile char *) start)[off] = 0;
+    }
+}
+
+/**
+ * Returns the size of a region that can hold block_sz bytes. For every page_sz
+ * bytes we need one page, so anything less than page_sz bytes should still
+ * result in 1 page.
+ *
+ * @param block_sz
+ */
+static size_t region_size_for(size_t block_sz)
+{
+    size_t num_pages = block_sz / page_sz;
+    if( (block_sz % page_sz) != 0 ){
+        num_pages += 1;
+    }
+    /* the total size of the region we are storing blocks in 
+     * will be the num_pages * page_sz */
+    return num_pages * page_sz;
+}
+
+/**
+ * Reads a size in bytes from the environment, rounded up to whole pages.
+ * Returns def if the variable is not set.
+ *
+ * @param name, def
+ */
+static size_t env_pages(const char *name, size_t def)
+{
+    char *value = getenv(name);
+    if (value == NULL) {
+        return def;
+    }
+    size_t bytes = strtoul(value, NULL, 10);
+    return bytes == 0 ? 0 : region_size_for(bytes);
+}
+
+/**
+ * Reads the value in the file at path as a byte count. Returns 0 if the file
+ * cannot be read or says "max". This uses plain read() rather than stdio,
+ * which could call malloc() while we hold list_lock.
+ *
+ * @param path
+ */
+static size_t read_limit_file(const char *path)
+{
+    char buf[64];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0 || strncmp(buf, "max", 3) == 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+    return strtoul(buf, NULL, 10);
+}
+
+/**
+ * Returns the memory limit of this process's cgroup: memory.max under
+ * cgroup v2, or memory.limit_in_bytes under v1. Returns 0 if there is no
+ * limit or it cannot be read.
+ *
+ * @param void
+ */
+size_t malloc_cgroup_limit(void)
+{
+    char buf[1024];
+    char path[1200];
+    int fd = open("/proc/self/cgroup", O_RDONLY | O_CLOEXEC);
+    ssize_t len = fd == -1 ? -1 : read(fd, buf, sizeof(buf) - 1);
+    if (fd != -1) {
+        close(fd);
+    }
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+
+    /* lines are "id:controllers:path"; v2 is "0::path" */
+    size_t limit = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(buf, "\n", &save); line != NULL && limit == 0;
+            line = strtok_r(NULL, "\n", &save)) {
+        if (strncmp(line, "0::/", 4) == 0) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.max", line + 3);
+            limit = read_limit_file(path);
+        } else if (strstr(line, ":memory:/") != NULL) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup/memory%s/memory.limit_in_bytes",
+                    strstr(line, ":memory:/") + 8);
+            limit = read_limit_file(path);
+            /* v1 reports "no limit" as a huge page-aligned number */
+            if (limit >= (size_t) 1 << 60) {
+                limit = 0;
+            }
+        }
+    }
+    return limit;
+}
+
+/**
+ * Reads the heap limits the first time a region is mapped:
+ *
+ * ALLOCATOR_SOFT_LIMIT=<bytes> reclaim before mapping past this (default: 0, none)
+ * ALLOCATOR_HARD_LIMIT=<bytes> fail allocations that would map past this (default: 0, none)
+ * ALLOCATOR_CGROUP_LIMIT=1 without a soft limit, use 90% of the cgroup's
+ *     memory limit (see malloc_cgroup_limit())
+ *
+ * @param void
+ */
+static void read_limit_config(void)
+{
+    soft_limit = env_pages("ALLOCATOR_SOFT_LIMIT", 0);
+    hard_limit = env_pages("ALLOCATOR_HARD_LIMIT", 0);
+
+    char *cgroup = getenv("ALLOCATOR_CGROUP_LIMIT");
+    if (soft_limit == 0 && cgroup != NULL && atoi(cgroup) == 1) {
+        soft_limit = malloc_cgroup_limit() / 10 * 9;
+    }
+}
+
+/**
+ * Runs read_limit_config() once.
+ *
+ * @param void
+ */
+static void load_limit_config(void)
+{
+    pthread_once(&limit_once, read_limit_config);
+}
+
+/**
+ * Sets the soft and hard limits on mapped bytes, replacing the ones from the
+ * environment; 0 removes a limit. Past the soft limit, the allocator
+ * reclaims memory before it maps more, maps only what each request needs,
+ * and calls the pressure callback. A request that would cross the hard limit
+ * fails with ENOMEM.
+ *
+ * @param soft, hard
+ */
+void malloc_set_limits(size_t soft, size_t hard)
+{
+    load_limit_config();
+    __atomic_store_n(&soft_limit, soft, __ATOMIC_RELAXED);
+    __atomic_store_n(&hard_limit, hard, __ATOMIC_RELAXED);
+}
+
+/**
+ * Registers a function that is called, with the mapped bytes and the soft
+ * limit, after an allocation has pushed the heap past the soft limit even
+ * though the allocator reclaimed what it could. The application can release
+ * memory of its own in it, and may call malloc() and free(). NULL removes the
+ * callback.
+ *
+ * @param cb, arg
+ */
+void malloc_set_pressure_callback(pressure_callback cb, void *arg)
+{
+    __atomic_store_n(&pressure_arg, arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&pressure_cb, cb, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns true if mapping region_sz more bytes would cross either limit.
+ *
+ * @param region_sz
+ */
+static bool limit_exceeded(size_t region_sz)
+{
+    size_t mapped = __atomic_load_n(&g_mapped, __ATOMIC_RELAXED) + region_sz;
+    size_t soft = __atomic_load_n(&soft_limit, __ATOMIC_RELAXED);
+    size_t hard = __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+    return (soft != 0 && mapped > soft) || (hard != 0 && mapped > hard);
+}
+
+/**
+ * Calls the pressure callback if this thread crossed the soft limit. The
+ * callback runs after list_lock has been released, so it may allocate and
+ * free; pressure it causes itself is not reported again.
+ *
+ * @param void
+ */
+static void notify_pressure(void)
+{
+    pressure_pending = false;
+    pressure_callback cb = __atomic_load_n(&pressure_cb, __ATOMIC_ACQUIRE);
+    if (cb == NULL || in_pressure_cb) {
+        return;
+    }
+
+    in_pressure_cb = true;
+    cb(__atomic_load_n(&g_mapped, __ATOMIC_RELAXED),
+            __atomic_load_n(&soft_limit, __ATOMIC_RELAXED),
+            __atomic_load_n(&pressure_arg, __ATOMIC_RELAXED));
+    in_pressure_cb = false;
+}
+
+/**
+ * Returns true if ptr lies inside the address-space reservation. This is a
+ * single range comparison; it says nothing about whether the range is
+ * committed.
+ *
+ * @param ptr
+ */
+static bool reserve_owns(void *ptr)
+{
+    return (char *) ptr >= reserve_start && (char *) ptr < reserve_end;
+}
+
+/**
+ * Reserves the address space that regions are committed from, the first
+ * time a region is requested. The reservation is PROT_NONE and
+ * MAP_NORESERVE, so it costs neither memory nor commit charge until pages
+ * are committed. Configured with:
+ *
+ * ALLOCATOR_RESERVE=<bytes> (default: 64 GiB; 0 maps every region on its own)
+ *
+ * If the reservation cannot be made, or runs out, regions are mapped
+ * individually as before. Expects reserve_lock to be held.
+ *
+ * @param void
+ */
+static void reserve_init(void)
+{
+    reserve_configured = true;
+    size_t size = env_pages("ALLOCATOR_RESERVE", RESERVE_DEFAULT);
+    if (size == 0) {
+        return;
+    }
+
+    void *start = mmap(NULL, size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) {
+        LOG("\t[X] Could not reserve %zu bytes of address space\n", size);
+        return;
+    }
+    reserve_start = start;
+    reserve_top = start;
+    reserve_end = reserve_start + size;
+}
+
+/**
+ * Takes region_sz bytes of address space from the reservation: from the
+ * lowest hole that fits, or else from the top. Returns NULL if there is no
+ * room (or no reservation). Expects reserve_lock to be held.
+ *
+ * @param region_sz
+ */
+static char *reserve_take(size_t region_sz)
+{
+    for (size_t i = 0; i < reserve_nholes; ++i) {
+        struct reserve_hole *hole = &reserve_holes[i];
+        if (hole->len >= region_sz) {
+            char *start = hole->start;
+            hole->start += region_sz;
+            hole->len -= region_sz;
+            if (hole->len == 0) {
+                memmove(hole, hole + 1, (--reserve_nholes - i) * sizeof(*hole));
+            }
+            return start;
+        }
+    }
+
+    if (reserve_top == NULL || region_sz > (size_t) (reserve_end - reserve_top)) {
+        return NULL;
+    }
+    char *start = reserve_top;
+    reserve_top += region_sz;
+    return start;
+}
+
+/**
+ * Gives [start, start + len) back to the reservation. A range at the top
+ * lowers the top (along with any holes it uncovers); anything else becomes a
+ * hole, merged with its neighbors. If the hole table is full the range is
+ * simply not reused. Expects reserve_lock to be held.
+ *
+ * @param start, len
+ */
+static void reserve_put(char *start, size_t len)
+{
+    if (start + len == reserve_top) {
+        reserve_top = start;
+        while (reserve_nholes > 0) {
+            struct reserve_hole *last = &reserve_holes[reserve_nholes - 1];
+            if (last->start + last->len != reserve_top) {
+                break;
+            }
+            reserve_top = last->start;
+            reserve_nholes--;
+        }
+        return;
+    }
+
+    size_t i = 0;
+    while (i < reserve_nholes && reserve_holes[i].start < start) {
+        i++;
+    }
+    bool joins_prev = i > 0 && reserve_holes[i - 1].start + reserve_holes[i - 1].len == start;
+    bool joins_next = i < reserve_nholes && start + len == reserve_holes[i].start;
+
+    if (joins_prev && joins_next) {
+        reserve_holes[i - 1].len += len + reserve_holes[i].len;
+        memmove(&reserve_holes[i], &reserve_holes[i + 1],
+                (--reserve_nholes - i) * sizeof(struct reserve_hole));
+    } else if (joins_prev) {
+        reserve_holes[i - 1].len += len;
+    } else if (joins_next) {
+        reserve_holes[i].start = start;
+        reserve_holes[i].len += len;
+    } else if (reserve_nholes < RESERVE_HOLES) {
+        memmove(&reserve_holes[i + 1], &reserve_holes[i],
+                (reserve_nholes++ - i) * sizeof(struct reserve_hole));
+        reserve_holes[i] = (struct reserve_hole) { start, len };
+    }
+}
+
+/**
+ * Commits region_sz bytes of the reservation for a new region by making
+ * them readable and writable; their pages are faulted in on first touch.
+ * Returns NULL if the reservation has no room left.
+ *
+ * @param region_sz
+ */
+static void *reserve_commit(size_t region_sz)
+{
+    lock_acquire(&reserve_lock);
+    if (!reserve_configured) {
+        reserve_init();
+    }
+    char *start = reserve_take(region_sz);
+    lock_release(&reserve_lock);
+
+    if (start == NULL) {
+        return NULL;
+    }
+    if (mprotect(start, region_sz, PROT_READ | PROT_WRITE) == -1) {
+        lock_acquire(&reserve_lock);
+        reserve_put(start, region_sz);
+        lock_release(&reserve_lock);
+        return NULL;
+    }
+    if (map_populate != 0) {
+        prefault(start, region_sz);
+    }
+    return start;
+}
+
+static struct stat_counters *stat_mine(void);
+
+/**
+ * If the current region has no reusable space, this requests space from the OS 
+ * using mmap() and adds the new block to the end of the linked list. Regions
+ * are committed from the address-space reservation (see reserve_init()) when
+ * it has room, so they sit next to each other and add no mappings of their
+ * own; otherwise each one is mapped separately.
+ *
+ * @param region_sz
+ */
+void *request(size_t region_sz){
+    LOGP("\t---- REQUEST() ----\n");
+    LAT_START(map_start);
+
+    load_limit_config();
+    size_t hard = __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&g_mapped, region_sz, __ATOMIC_RELAXED) > hard && hard != 0) {
+        __atomic_sub_fetch(&g_mapped, region_sz, __ATOMIC_RELAXED);
+        STAT_ADD(limit_failures, 1);
+        LOG("\t[X] Mapping %zu bytes would cross the hard limit\n", region_sz);
+        LAT_END(LAT_MMAP, map_start);
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *block = reserve_commit(region_sz);
+
+    if(block == NULL){
+        /* note that we are mmaping region_sz */
+        block = mmap(NULL, region_sz, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | map_populate, -1, 0);
+    }
+
+    /* error checking */
+    if(block == MAP_FAILED){
+        perror("mmap");
+        __atomic_sub_fetch(&g_mapped, region_sz, __ATOMIC_RELAXED);
+        LAT_END(LAT_MMAP, map_start);
+        return NULL;
+    }
+    STAT_ADD(mmap_calls, 1);
+    LAT_END(LAT_MMAP, map_start);
+    LOGP("\t[✓] Successfully request() memory.\n");
+    return block;
+}
+
+/**
+ * Returns a region obtained with request() to the OS. A region inside the
+ * reservation is decommitted by mapping fresh PROT_NONE pages over it, which
+ * frees its memory but keeps the address space reserved for later regions.
+ * Returns 0 on success and -1 on failure, like munmap().
+ *
+ * @param region, region_sz
+ */
+static int release(void *region, size_t region_sz)
+{
+    LAT_START(unmap_start);
+    int ret = 0;
+
+    if (!reserve_owns(region)) {
+        ret = munmap(region, region_sz);
+    } else if (mmap(region, region_sz, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                -1, 0) == MAP_FAILED) {
+        ret = -1;
+    } else {
+        lock_acquire(&reserve_lock);
+        reserve_put(region, region_sz);
+        lock_release(&reserve_lock);
+    }
+    if (ret == 0) {
+        __atomic_sub_fetch(&g_mapped, region_sz, __ATOMIC_RELAXED);
+    }
+
+    LAT_END(LAT_MUNMAP, unmap_start);
+    return ret;
+}
+
+/**
+ * Populates any given mem_block struct.
+ *
+ * @param block, requested_sz, block_sz, start
+ */
+void populate(struct mem_block *block, size_t requested_sz, size_t block_sz, struct mem_block *start){
+    LOGP("\t---- POPULATE() ----\n");
+    /* each allocation takes the next id of its thread's batch: ids are unique,
+     * but only one thread's are in allocation order */
+    if (my_next_id == my_end_id) {
+        my_next_id = __atomic_fetch_add(&g_allocations, ALLOC_ID_BATCH, __ATOMIC_RELAXED);
+        my_end_id = my_next_id + ALLOC_ID_BATCH;
+    }
+    block->alloc_id = my_next_id++;
+    /* naming each block */
+    sprintf(block->name, "Allocation %lu", block->alloc_id);
+    /* block.size should represent the size of the block */
+    block->size = block_sz;
+    /* block.usage represents how much of the region is being used by the block, AKA block_sz */
+    block->usage = requested_sz;
+    /* block.region_start should point to the beginning of the mapped region */
+    block->region_start = start;
+    /* each new block will be added to the end of the region so next should be NULL */
+    block->next = NULL;
+    /* only region starts carry metadata; add_region() sets it up */
+    block->meta = NULL;
+    /* no lifetime record yet (region starts get their region_size next) */
+    block->region_size = 0;
+    block->tag = 0;
+    /* nothing has been freed yet */
+    block->freed_at = 0;
+    //print_block(block);
+    LOGP("\t[✓] Successfully populate() memory\n");
+}
+
+/**
+ * Allocates memory for region metadata. We cannot call our own malloc() here,
+ * so metadata comes from 1 MiB chunks mapped on the side and is handed out in
+ * power-of-two sizes with a free list per size (one extra mapping per chunk
+ * rather than one per region). Returns NULL if no memory is available.
+ *
+ * @param bytes
+ */
+static void *meta_alloc(size_t bytes)
+{
+    unsigned int cls = META_MIN_CLASS;
+    while (((size_t) 1 << cls) < bytes) {
+        cls++;
+    }
+    size_t chunk_sz = (size_t) 1 << cls;
+
+    if (chunk_sz >= META_CHUNK_SIZE) {
+        void *ptr = mmap(NULL, chunk_sz, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return ptr == MAP_FAILED ? NULL : ptr;
+    }
+
+    lock_acquire(&meta_lock);
+    void *ptr = meta_free_lists[cls];
+    if (ptr != NULL) {
+        meta_free_lists[cls] = *(void **) ptr;
+        lock_release(&meta_lock);
+        return ptr;
+    }
+
+    if (meta_bump == NULL || chunk_sz > (size_t) (meta_bump_end - meta_bump)) {
+        void *chunk = mmap(NULL, META_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+            lock_release(&meta_lock);
+            perror("mmap");
+            return NULL;
+        }
+        meta_bump = chunk;
+        meta_bump_end = meta_bump + META_CHUNK_SIZE;
+    }
+
+    ptr = meta_bump;
+    meta_bump += chunk_sz;
+    lock_release(&meta_lock);
+    return ptr;
+}
+
+/**
+ * Returns memory from meta_alloc() to its free list.
+ *
+ * @param ptr, bytes
+ */
+static void meta_release(void *ptr, size_t bytes)
+{
+    unsigned int cls = META_MIN_CLASS;
+    while (((size_t) 1 << cls) < bytes) {
+        cls++;
+    }
+
+    if (((size_t) 1 << cls) >= META_CHUNK_SIZE) {
+        munmap(ptr, (size_t) 1 << cls);
+        return;
+    }
+    lock_acquire(&meta_lock);
+    *(void **) ptr = meta_free_lists[cls];
+    meta_free_lists[cls] = ptr;
+    lock_release(&meta_lock);
+}
+
+/**
+ * Thread exit destructor of stat_key: leaves the thread's counters for the
+ * next thread that registers (see tag_release_thread()).
+ *
+ * @param arg
+ */
+static void stat_release_thread(void *arg)
+{
+    struct stat_counters *counters = arg;
+    my_stats = NULL;
+    lock_acquire(&stat_lock);
+    counters->spare = g_stat_spare;
+    g_stat_spare = counters;
+    lock_release(&stat_lock);
+}
+
+/**
+ * Runs once, before the first thread registers its counters.
+ *
+ * @param void
+ */
+static void stat_init(void)
+{
+    pthread_key_create(&stat_key, stat_release_thread);
+}
+
+/**
+ * Returns the calling thread's counters, giving it some on first use: an
+ * exited thread's block if there is one, or a new one from meta_alloc().
+ * Returns NULL if no memory is available.
+ *
+ * @param void
+ */
+static struct stat_counters *stat_mine(void)
+{
+    struct stat_counters *counters = my_stats;
+    if (counters != NULL) {
+        return counters;
+    }
+    pthread_once(&stat_once, stat_init);
+
+    lock_acquire(&stat_lock);
+    counters = g_stat_spare;
+    if (counters != NULL) {
+        g_stat_spare = counters->spare;
+        lock_release(&stat_lock);
+    } else {
+        lock_release(&stat_lock);
+        counters = meta_alloc(sizeof(struct stat_counters));
+        if (counters == NULL) {
+            return NULL;
+        }
+        memset(counters, 0, sizeof(struct stat_counters));
+        lock_acquire(&stat_lock);
+        counters->next = g_stat_threads;
+        __atomic_store_n(&g_stat_threads, counters, __ATOMIC_RELEASE);
+        lock_release(&stat_lock);
+    }
+    my_stats = counters;
+    pthread_setspecific(stat_key, counters);
+    return counters;
+}
+
+/**
+ * Adds the counter fields of from (read while their thread may be updating
+ * them) to into.
+ *
+ * @param into, from
+ */
+static void stat_merge(struct alloc_stats *into, struct alloc_stats *from)
+{
+#define STAT_MERGE(field) \
+    into->field += __atomic_load_n(&from->field, __ATOMIC_RELAXED)
+    STAT_MERGE(searches);
+    STAT_MERGE(search_steps);
+    STAT_MERGE(mmap_calls);
+    STAT_MERGE(munmap_calls);
+    STAT_MERGE(purge_calls);
+    STAT_MERGE(purged_bytes);
+    STAT_MERGE(sampled);
+    STAT_MERGE(arena_bytes);
+    STAT_MERGE(pressure_events);
+    STAT_MERGE(limit_failures);
+    STAT_MERGE(nt_bytes);
+    STAT_MERGE(long_lived_allocs);
+    STAT_MERGE(lifetime_predictions);
+    STAT_MERGE(lifetime_correct);
+#undef STAT_MERGE
+}
+
+/**
+ * Returns the number of bytes needed for the arrays of a region_meta with
+ * capacity entries.
+ *
+ * @param capacity
+ */
+static size_t meta_bytes(size_t capacity)
+{
+    return capacity * (sizeof(struct mem_block *) + sizeof(uint32_t));
+}
+
+/**
+ * Points a region_meta at new arrays with room for capacity entries; both
+ * arrays live in one allocation. The struct itself never moves, since its lock
+ * may be waited on while the arrays grow. Returns false if no memory is
+ * available.
+ *
+ * @param meta, capacity
+ */
+static bool meta_arrays(struct region_meta *meta, size_t capacity)
+{
+    struct mem_block **blocks = meta_alloc(meta_bytes(capacity));
+    if (blocks == NULL) {
+        return false;
+    }
+    meta->capacity = capacity;
+    meta->blocks = blocks;
+    meta->free_sz = (uint32_t *) (blocks + capacity);
+    return true;
+}
+
+/**
+ * Reusable space of a block, saturated to fit the 32-bit free_sz entries.
+ *
+ * @param block
+ */
+static uint32_t meta_free_of(struct mem_block *block)
+{
+    size_t free_sz = block->size - block->usage;
+    return free_sz > UINT32_MAX ? UINT32_MAX : (uint32_t) free_sz;
+}
+
+/**
+ * Sets up the metadata for a newly mapped region whose only block is region.
+ * Returns false if no memory is available.
+ *
+ * @param region
+ */
+static bool meta_create(struct mem_block *region)
+{
+    struct region_meta *meta = meta_alloc(sizeof(struct region_meta));
+    if (meta == NULL) {
+        return false;
+    }
+    if (!meta_arrays(meta, 16)) {
+        meta_release(meta, sizeof(struct region_meta));
+        return false;
+    }
+    meta->lock = (struct alloc_lock) ALLOC_LOCK_INITIALIZER;
+    meta->pinned = false;
+    meta->growable = false;
+    meta->long_lived = false;
+    meta->life = 0;
+    meta->count = 1;
+    meta->blocks[0] = region;
+    meta->free_sz[0] = meta_free_of(region);
+    region->meta = meta;
+    return true;
+}
+
+/**
+ * Releases a region's metadata; called right before the region is unmapped.
+ *
+ * @param region
+ */
+static void meta_destroy(struct mem_block *region)
+{
+    if (region->meta != NULL) {
+        meta_release(region->meta->blocks, meta_bytes(region->meta->capacity));
+        meta_release(region->meta, sizeof(struct region_meta));
+        region->meta = NULL;
+    }
+}
+
+/**
+ * Finds a block's index in its region's arrays. Blocks are stored in address
+ * order, so this is a binary search over the packed pointer array.
+ *
+ * @param meta, block
+ */
+static size_t meta_index(struct region_meta *meta, struct mem_block *block)
+{
+    size_t lo = 0, hi = meta->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (meta->blocks[mid] < block) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Refreshes a block's free_sz entry after its size or usage changed. Blocks
+ * outside the list (sampled allocations) have no metadata and are ignored.
+ *
+ * @param block
+ */
+static void meta_sync(struct mem_block *block)
+{
+    struct region_meta *meta = block->region_start->meta;
+    if (meta == NULL) {
+        return;
+    }
+    meta->free_sz[meta_index(meta, block)] = meta_free_of(block);
+}
+
+/**
+ * Makes sure a region's arrays have room for one more block, growing them if
+ * needed. Every block of a region must be in its arrays (meta_empty() and
+ * meta_index() rely on it), so this is called before a block is carved out,
+ * and the carving is abandoned if it returns false (no memory available).
+ *
+ * @param meta
+ */
+static bool meta_reserve(struct region_meta *meta)
+{
+    if (meta == NULL || meta->count < meta->capacity) {
+        return true;
+    }
+
+    struct mem_block **blocks = meta->blocks;
+    uint32_t *free_sz = meta->free_sz;
+    size_t capacity = meta->capacity;
+    if (!meta_arrays(meta, capacity * 2)) {
+        return false;
+    }
+    memcpy(meta->blocks, blocks, meta->count * sizeof(struct mem_block *));
+    memcpy(meta->free_sz, free_sz, meta->count * sizeof(uint32_t));
+    meta_release(blocks, meta_bytes(capacity));
+    return true;
+}
+
+/**
+ * Records that block was linked into the list right after prev (in the same
+ * region). The room for it must have been made with meta_reserve().
+ *
+ * @param prev, block
+ */
+static void meta_insert(struct mem_block *prev, struct mem_block *block)
+{
+    struct region_meta *meta = prev->region_start->meta;
+    if (meta == NULL) {
+        return;
+    }
+
+    size_t i = meta_index(meta, prev) + 1;
+    memmove(meta->blocks + i + 1, meta->blocks + i,
+            (meta->count - i) * sizeof(struct mem_block *));
+    memmove(meta->free_sz + i + 1, meta->free_sz + i,
+            (meta->count - i) * sizeof(uint32_t));
+    meta->blocks[i] = block;
+    meta->free_sz[i] = meta_free_of(block);
+    meta->count++;
+}
+
+/**
+ * Returns the first block of the region that follows meta's region in the
+ * list, or NULL if it is the last one. Expects the region to be locked.
+ *
+ * @param meta
+ */
+static struct mem_block *meta_next(struct region_meta *meta)
+{
+    return meta->blocks[meta->count - 1]->next;
+}
+
+/**
+ * Returns true if every block in a region is free.
+ *
+ * @param meta
+ */
+static bool meta_empty(struct region_meta *meta)
+{
+    for (size_t i = 0; i < meta->count; ++i) {
+        if (meta->blocks[i]->usage != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Scalar search kernel: returns the first index in [from, to) whose free space
+ * is at least size, or to if there is none.
+ *
+ * @param free_sz, from, to, size
+ */
+static size_t find_scalar(const uint32_t *free_sz, size_t from, size_t to, uint32_t size)
+{
+    for (size_t i = from; i < to; ++i) {
+        if (free_sz[i] >= size) {
+            return i;
+        }
+    }
+    return to;
+}
+
+#ifdef __SSE2__
+/**
+ * SSE2 search kernel: compares four entries at a time. SSE2 only has signed
+ * 32-bit compares, so both sides are biased by INT_MIN to compare unsigned.
+ *
+ * @param free_sz, from, to, size
+ */
+static size_t find_sse2(const uint32_t *free_sz, size_t from, size_t to, uint32_t size)
+{
+    const __m128i bias = _mm_set1_epi32(INT_MIN);
+    /* free >= size  <=>  free > size - 1 (size is never 0) */
+    const __m128i want = _mm_xor_si128(_mm_set1_epi32((int) (size - 1)), bias);
+    size_t i = from;
+
+    for (; i + 4 <= to; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (free_sz + i));
+        __m128i hit = _mm_cmpgt_epi32(_mm_xor_si128(v, bias), want);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(free_sz, i, to, size);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * AVX2 search kernel: same as find_sse2(), eight entries at a time. Compiled
+ * for AVX2 regardless of the build flags and only used if the CPU has it.
+ *
+ * @param free_sz, from, to, size
+ */
+__attribute__((target("avx2")))
+static size_t find_avx2(const uint32_t *free_sz, size_t from, size_t to, uint32_t size)
+{
+    const __m256i bias = _mm256_set1_epi32(INT_MIN);
+    const __m256i want = _mm256_xor_si256(_mm256_set1_epi32((int) (size - 1)), bias);
+    size_t i = from;
+
+    for (; i + 8 <= to; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (free_sz + i));
+        __m256i hit = _mm256_cmpgt_epi32(_mm256_xor_si256(v, bias), want);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(free_sz, i, to, size);
+}
+#endif
+
+/**
+ * Picks the search kernel for this CPU, unless ALLOCATOR_SIMD=scalar|sse2|avx2
+ * asks for a specific one (useful for benchmarking). Runs once, through
+ * find_once.
+ *
+ * @param void
+ */
+static void select_find_kernel(void)
+{
+    char *simd = getenv("ALLOCATOR_SIMD");
+    find_kernel kernel = find_scalar;
+
+#ifdef __SSE2__
+    kernel = find_sse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")
+            && (simd == NULL || strcmp(simd, "avx2") == 0)) {
+        kernel = find_avx2;
+    }
+#endif
+
+    if (simd != NULL && strcmp(simd, "scalar") == 0) {
+        kernel = find_scalar;
+    }
+    meta_find_kernel = kernel;
+    LOG("\tUsing %s free-space search\n",
+            kernel == find_scalar ? "scalar" : "SIMD");
+}
+
+#ifdef __SSE2__
+/**
+ * Streaming fill kernel: writes len bytes of c to dst with non-temporal
+ * stores, which go around the cache instead of evicting the application's
+ * working set. The unaligned head and the tail are left to memset().
+ *
+ * @param dst, c, len
+ */
+static void fill_nt_sse2(void *dst, int c, size_t len)
+{
+    char *p = dst;
+    size_t head = -(uintptr_t) p & 15;
+    memset(p, c, head);
+    p += head;
+    len -= head;
+
+    const __m128i v = _mm_set1_epi8((char) c);
+    for (; len >= 64; p += 64, len -= 64) {
+        _mm_stream_si128((__m128i *) p, v);
+        _mm_stream_si128((__m128i *) (p + 16), v);
+        _mm_stream_si128((__m128i *) (p + 32), v);
+        _mm_stream_si128((__m128i *) (p + 48), v);
+    }
+    /* order the streaming stores before anything that follows */
+    _mm_sfence();
+    memset(p, c, len);
+}
+
+/**
+ * Streaming copy kernel: like fill_nt_sse2(), for copying len bytes from src
+ * to dst. The source is read normally; only the stores bypass the cache.
+ *
+ * @param dst, src, len
+ */
+static void copy_nt_sse2(void *dst, const void *src, size_t len)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t) d & 15;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; d += 64, s += 64, len -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *) s);
+        __m128i b = _mm_loadu_si128((const __m128i *) (s + 16));
+        __m128i e = _mm_loadu_si128((const __m128i *) (s + 32));
+        __m128i f = _mm_loadu_si128((const __m128i *) (s + 48));
+        _mm_stream_si128((__m128i *) d, a);
+        _mm_stream_si128((__m128i *) (d + 16), b);
+        _mm_stream_si128((__m128i *) (d + 32), e);
+        _mm_stream_si128((__m128i *) (d + 48), f);
+    }
+    _mm_sfence();
+    memcpy(d, s, len);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * AVX2 streaming fill kernel: same as fill_nt_sse2(), 32 bytes per store.
+ *
+ * @param dst, c, len
+ */
+__attribute__((target("avx2")))
+static void fill_nt_avx2(void *dst, int c, size_t len)
+{
+    char *p = dst;
+    size_t head = -(uintptr_t) p & 31;
+    memset(p, c, head);
+    p += head;
+    len -= head;
+
+    const __m256i v = _mm256_set1_epi8((char) c);
+    for (; len >= 128; p += 128, len -= 128) {
+        _mm256_stream_si256((__m256i *) p, v);
+        _mm256_stream_si256((__m256i *) (p + 32), v);
+        _mm256_stream_si256((__m256i *) (p + 64), v);
+        _mm256_stream_si256((__m256i *) (p + 96), v);
+    }
+    _mm_sfence();
+    memset(p, c, len);
+}
+
+/**
+ * AVX2 streaming copy kernel: same as copy_nt_sse2(), 32 bytes per store.
+ *
+ * @param dst, src, len
+ */
+__attribute__((target("avx2")))
+static void copy_nt_avx2(void *dst, const void *src, size_t len)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t) d & 31;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 128; d += 128, s += 128, len -= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) s);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (s + 32));
+        __m256i e = _mm256_loadu_si256((const __m256i *) (s + 64));
+        __m256i f = _mm256_loadu_si256((const __m256i *) (s + 96));
+        _mm256_stream_si256((__m256i *) d, a);
+        _mm256_stream_si256((__m256i *) (d + 32), b);
+        _mm256_stream_si256((__m256i *) (d + 64), e);
+        _mm256_stream_si256((__m256i *) (d + 96), f);
+    }
+    _mm_sfence();
+    memcpy(d, s, len);
+}
+#endif
+
+/**
+ * Picks the streaming fill/copy kernels for this CPU (ALLOCATOR_SIMD applies
+ * as in select_find_kernel(); "scalar" turns streaming off) and reads the
+ * size from which they are used:
+ *
+ * ALLOCATOR_NT_THRESHOLD=<bytes> (default: half the last-level cache, at
+ * most 4 MiB; 0 never streams)
+ *
+ * Smaller fills and copies stay with memset() / memcpy(): their data is
+ * likely to be used again soon, and is better off in the cache.
+ *
+ * @param void
+ */
+static void select_bulk_kernels(void)
+{
+    char *simd = getenv("ALLOCATOR_SIMD");
+
+#ifdef __SSE2__
+    nt_fill = fill_nt_sse2;
+    nt_copy = copy_nt_sse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")
+            && (simd == NULL || strcmp(simd, "avx2") == 0)) {
+        nt_fill = fill_nt_avx2;
+        nt_copy = copy_nt_avx2;
+    }
+    /* glibc answers this from cpuid here, without allocating */
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#else
+    long llc = 0;
+#endif
+
+    nt_threshold = NT_THRESHOLD_DEFAULT;
+    if (llc > 0 && (size_t) llc / 2 < nt_threshold) {
+        nt_threshold = llc / 2;
+    }
+    char *threshold = getenv("ALLOCATOR_NT_THRESHOLD");
+    if (threshold != NULL) {
+        nt_threshold = strtoul(threshold, NULL, 10);
+    }
+
+    if (nt_threshold == 0 || (simd != NULL && strcmp(simd, "scalar") == 0)) {
+        nt_fill = NULL;
+        nt_copy = NULL;
+    } else if (nt_threshold < NT_THRESHOLD_MIN) {
+        nt_threshold = NT_THRESHOLD_MIN;
+    }
+    LOG("\tStreaming fills/copies from %zu bytes: %s\n", nt_threshold,
+            nt_fill == NULL ? "off" : "on");
+}
+
+/**
+ * Fills len bytes at dst with c: the allocator's memset() for bulk work
+ * (calloc(), scribbling). Fills of nt_threshold bytes or more use streaming
+ * stores, so zeroing a multi-megabyte block does not flush the cache.
+ *
+ * @param dst, c, len
+ */
+static void bulk_fill(void *dst, int c, size_t len)
+{
+    pthread_once(&bulk_once, select_bulk_kernels);
+    if (nt_fill != NULL && len >= nt_threshold) {
+        STAT_ADD(nt_bytes, len);
+        nt_fill(dst, c, len);
+        return;
+    }
+    memset(dst, c, len);
+}
+
+/**
+ * Copies len bytes from src to dst (which must not overlap): the
+ * allocator's memcpy() for bulk work (realloc()), streaming like
+ * bulk_fill().
+ *
+ * @param dst, src, len
+ */
+static void bulk_copy(void *dst, const void *src, size_t len)
+{
+    pthread_once(&bulk_once, select_bulk_kernels);
+    if (nt_copy != NULL && len >= nt_threshold) {
+        STAT_ADD(nt_bytes, len);
+        nt_copy(dst, src, len);
+        return;
+    }
+    memcpy(dst, src, len);
+}
+
+/**
+ * Returns the first index in [from, to) of meta whose block has at least size
+ * bytes of reusable space, or to if there is none. Entries that saturated at
+ * UINT32_MAX are double-checked against the block header. A region of the
+ * other lifetime class than the allocation being placed (see life_predict())
+ * has no space for it.
+ *
+ * @param meta, from, to, size
+ */
+static size_t meta_find(struct region_meta *meta, size_t from, size_t to, size_t size)
+{
+    pthread_once(&find_once, select_find_kernel);
+    if (meta->long_lived != life_long) {
+        /* keep long- and short-lived allocations in separate regions */
+        return to;
+    }
+
+    uint32_t want = size > UINT32_MAX ? UINT32_MAX : (uint32_t) size;
+    size_t i = from;
+    while ((i = meta_find_kernel(meta->free_sz, i, to, want)) < to) {
+        struct mem_block *block = meta->blocks[i];
+        if (want != UINT32_MAX || block->size - block->usage >= size) {
+            break;
+        }
+        i++;
+    }
+
+    STAT_ADD(search_steps, (i < to ? i + 1 : to) - from);
+    return i;
+}
+
+/**
+ * Exact reusable space of entry i (free_sz[i] may be saturated).
+ *
+ * @param meta, i
+ */
+static size_t meta_free(struct region_meta *meta, size_t i)
+{
+    if (meta->free_sz[i] != UINT32_MAX) {
+        return meta->free_sz[i];
+    }
+    return meta->blocks[i]->size - meta->blocks[i]->usage;
+}
+
+/**
+ * Returns the tag for a block name, interning it if it has not been seen yet.
+ * Names are compared in full, so this is only done by malloc_name(); every
+ * other operation carries the tag index in the block header. Expects tag_lock
+ * to be held.
+ *
+ * @param name
+ */
+static unsigned int tag_intern(const char *name)
+{
+    for (unsigned int i = 1; i < g_num_tags; ++i) {
+        if (strncmp(g_tags[i].name, name, sizeof(g_tags[i].name)) == 0) {
+            return i;
+        }
+    }
+
+    if (g_num_tags == MAX_TAGS) {
+        /* the table is full: the last tag collects everything else */
+        snprintf(g_tags[MAX_TAGS - 1].name, sizeof(g_tags[0].name), "(other)");
+        return MAX_TAGS - 1;
+    }
+
+    unsigned int tag = g_num_tags;
+    snprintf(g_tags[tag].name, sizeof(g_tags[tag].name), "%s", name);
+    __atomic_store_n(&g_num_tags, tag + 1, __ATOMIC_RELEASE);
+    return tag;
+}
+
+/**
+ * Gives the calling thread its own counters, registering them so readers can
+ * merge them. Counters outlive their thread: the pending counts are still
+ * part of the totals, so an exited thread's block is reused as it is rather
+ * than unmapped, which keeps readers lock-free and the registry no larger
+ * than the most threads ever alive at once.
+ *
+ * @param void
+ */
+static void tag_register_thread(void)
+{
+    lock_acquire(&tag_lock);
+    struct tag_counters *counters = g_tag_spare;
+    if (counters != NULL) {
+        g_tag_spare = counters->spare;
+        lock_release(&tag_lock);
+    } else {
+        lock_release(&tag_lock);
+        counters = meta_alloc(sizeof(struct tag_counters));
+        if (counters == NULL) {
+            return;
+        }
+        memset(counters, 0, sizeof(struct tag_counters));
+        lock_acquire(&tag_lock);
+        counters->next = g_tag_threads;
+        __atomic_store_n(&g_tag_threads, counters, __ATOMIC_RELEASE);
+        lock_release(&tag_lock);
+    }
+    my_tags = counters;
+    pthread_setspecific(tag_key, counters);
+}
+
+/**
+ * Thread exit destructor of tag_key: leaves the thread's counters for the
+ * next thread that registers. tag_lock orders the last plain stores of this
+ * thread before those of the next owner.
+ *
+ * @param arg
+ */
+static void tag_release_thread(void *arg)
+{
+    struct tag_counters *counters = arg;
+    my_tags = NULL;
+    lock_acquire(&tag_lock);
+    counters->spare = g_tag_spare;
+    g_tag_spare = counters;
+    lock_release(&tag_lock);
+}
+
+/**
+ * Raises a tag's peak to live if it is higher.
+ *
+ * @param tag, live
+ */
+static void tag_raise_peak(unsigned int tag, long live)
+{
+    long peak = __atomic_load_n(&g_tags[tag].peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&g_tags[tag].peak_bytes,
+                &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * Records an allocation (allocs > 0), a free (allocs < 0) or a resize
+ * (allocs == 0) of a tagged block. The counts go to the calling thread's own
+ * counters with plain stores; once a thread has more than TAG_FLUSH_BYTES
+ * pending for a tag, they are folded into the global count, which is where
+ * peaks are tracked. Untagged blocks are not counted.
+ *
+ * @param block, bytes, allocs
+ */
+static void tag_account(struct mem_block *block, long bytes, long allocs)
+{
+    unsigned int tag = block->tag;
+    if (tag == 0) {
+        return;
+    }
+
+    if (my_tags == NULL) {
+        tag_register_thread();
+    }
+    struct tag_counters *counters = my_tags;
+    if (counters == NULL) {
+        /* out of memory for counters: share the base ones */
+        counters = &g_tag_base;
+        lock_acquire(&tag_lock);
+    }
+    long pending = counters->bytes[tag] + bytes;
+
+    __atomic_store_n(&counters->allocs[tag], counters->allocs[tag] + allocs,
+            __ATOMIC_RELAXED);
+    if (allocs > 0) {
+        __atomic_store_n(&counters->total[tag], counters->total[tag] + 1,
+                __ATOMIC_RELAXED);
+    }
+
+    if (pending >= TAG_FLUSH_BYTES || pending <= -TAG_FLUSH_BYTES) {
+        __atomic_store_n(&counters->bytes[tag], 0, __ATOMIC_RELAXED);
+        long live = __atomic_add_fetch(&g_tags[tag].live_bytes, pending,
+                __ATOMIC_RELAXED);
+        tag_raise_peak(tag, live);
+    } else {
+        __atomic_store_n(&counters->bytes[tag], pending, __ATOMIC_RELAXED);
+    }
+
+    if (counters == &g_tag_base) {
+        lock_release(&tag_lock);
+    }
+}
+
+/**
+ * Payload bytes of a block, as counted by the tag accounting.
+ *
+ * @param block
+ */
+static long tag_bytes(struct mem_block *block)
+{
+    return (long) (block->usage - sizeof(struct mem_block));
+}
+
+/**
+ * Creates a block and adds it to linked list by splitting avaliable block.
+ * Returns NULL if the region's metadata has no room for the new block and
+ * cannot grow (see meta_reserve()).
+ *
+ * @param block, size
+ */
+void *split(void *block, size_t size){
+    /* we can assume the block given to us is big enough */
+
+    LOGP("\t\t---- SPLIT() ----\n");
+
+    struct mem_block *curr = block;
+    struct mem_block *new = NULL;
+
+    if( curr->usage == 0 ){
+        LOG("\t\tUpdating block (alloc_id): %lu\n", curr->alloc_id);
+        /* we just want to update the block's usage */
+        curr->usage = size;
+        curr->tag = 0;
+        meta_sync(curr);
+        return curr;
+    }
+
+    /* SPLITTING THE BLOCK */
+
+    if( !meta_reserve(curr->region_start->meta) ){
+        LOGP("\t\t[X] No memory for the region's metadata\n");
+        return NULL;
+    }
+    LOG("\t\tSplitting block (alloc_id): %lu\n", curr->alloc_id);
+    /* update the curr size */
+    size_t new_block_sz = curr->size;
+    curr->size = curr->usage;
+    new_block_sz -= curr->usage;
+    new = (void *)curr + curr->size; /* includes sizeof(struct mem_block) */
+    /* populate new mem_block */
+    populate(new, size, new_block_sz, curr->region_start);
+
+    /* case where we split in the middle */
+    if( curr->next != NULL ){ 
+        /* update linked list */
+        new->next = curr->next;
+    }
+    curr->next = new;
+
+    /* keep the region's free-space array in step with the list */
+    meta_sync(curr);
+    meta_insert(curr, new);
+    
+    LOGP("\t\t[✓] Successfully split() block.\n");
+    return new;
+}
+
+/**
+ * Using the first fit FSM implementation, it reuses free memory in a region
+ * by finding the first, suitable memory block. Each region's packed free-space
+ * array is searched with meta_find() rather than walking the block headers.
+ * Like the other FSM functions, it expects list_lock to be held (shared) and
+ * returns with the found block's region locked; reuse() splits the block and
+ * unlocks it.
+ *
+ * @param size
+ */
+void *first_fit(size_t size)
+{
+    LOGP("\t---- FIRST_FIT() ----\n");
+    struct mem_block *region = g_head;
+    /* We want to keep searching until we find a block that is free 
+    * and large enough */
+    while( region != NULL ){  
+        struct region_meta *meta = region->meta;
+        lock_acquire(&meta->lock);
+        size_t i = meta_find(meta, 0, meta->count, size);
+        /* case where block is partially free */
+        if( i < meta->count ){
+            LOG("\t[✓] Found a block! size free: %zu\n", meta_free(meta, i));
+            /* returns a pointer of first half of block to be split */
+            return meta->blocks[i];
+        }
+        region = meta_next(meta);
+        lock_release(&meta->lock);
+    }
+    LOGP("\t[X] No reusable space\n");
+    return NULL;
+}
+
+/**
+ * Locks the region of a block picked by worst_fit() or best_fit(). Regions are
+ * only locked one at a time while they are scanned, so another thread may have
+ * carved into the block since; returns false (with nothing locked) if it can
+ * no longer hold size bytes, and the search is repeated.
+ *
+ * @param block, size
+ */
+static bool lock_candidate(struct mem_block *block, size_t size)
+{
+    struct region_meta *meta = block->region_start->meta;
+    lock_acquire(&meta->lock);
+    if (block->size - block->usage >= size) {
+        return true;
+    }
+    lock_release(&meta->lock);
+    return false;
+}
+
+/**
+ * Using the worst fit FSM implementation, it reuses free memory in a region
+ * by finding the largest continuous memory block.
+ *
+ * @param size
+ */
+void *worst_fit(size_t size)
+{
+    LOGP("\t---- WORST_FIT() ----\n");
+    struct mem_block *worst;
+
+    do {
+        struct mem_block *region = g_head;
+        size_t worst_difference = 0, check_difference;
+        worst = NULL;
+
+        while( region != NULL ){
+            struct region_meta *meta = region->meta;
+            lock_acquire(&meta->lock);
+            size_t i = meta_find(meta, 0, meta->count, size);
+            while( i < meta->count ){
+                check_difference = meta_free(meta, i);
+                /* it is larger than the other value */
+                if( worst == NULL || check_difference > worst_difference ){
+                    worst = meta->blocks[i];
+                    worst_difference = check_difference;
+                }
+                i = meta_find(meta, i + 1, meta->count, size);
+            }
+            region = meta_next(meta);
+            lock_release(&meta->lock);
+        }
+    } while( worst != NULL && !lock_candidate(worst, size) );
+
+    return worst;
+}
+
+/**
+ * Using the best fit FSM implementation, it reuses free memory in a region
+ * by finding the first closest-in-size memory block.
+ *
+ * @param size
+ */
+void *best_fit(size_t size)
+{
+    LOGP("\t---- BEST_FIT() ----\n");
+    struct mem_block *best;
+
+    do {
+        struct mem_block *region = g_head;
+        size_t best_difference = 0, check_difference;
+        best = NULL;
+
+        while( region != NULL ){
+            struct region_meta *meta = region->meta;
+            lock_acquire(&meta->lock);
+            size_t i = meta_find(meta, 0, meta->count, size);
+            while( i < meta->count ){
+                check_difference = meta_free(meta, i);
+                if( check_difference == size ){
+                    /* an exact fit: keep this region locked */
+                    return meta->blocks[i];
+                }
+                /* it is closer than the other value; the first one wins ties */
+                if( best == NULL || check_difference < best_difference ){
+                    best = meta->blocks[i];
+                    best_difference = check_difference;
+                }
+                i = meta_find(meta, i + 1, meta->count, size);
+            }
+            region = meta_next(meta);
+            lock_release(&meta->lock);
+        }
+    } while( best != NULL && !lock_candidate(best, size) );
+
+    return best;
+}
+
+/**
+ * Using the next fit FSM implementation, it reuses free memory in a region
+ * by resuming the search where the previous one ended (the "rover") and
+ * wrapping around to the head of the list. This spreads allocations across
+ * the heap instead of piling small fragments up at the front of the list.
+ *
+ * @param size
+ */
+void *next_fit(size_t size)
+{
+    LOGP("\t---- NEXT_FIT() ----\n");
+    struct mem_block *start = __atomic_load_n(&g_rover, __ATOMIC_RELAXED);
+    if( start == NULL ){
+        start = g_head;
+    }
+    if( start == NULL ){
+        return NULL;
+    }
+
+    struct region_meta *start_meta = start->region_start->meta;
+    lock_acquire(&start_meta->lock);
+    size_t start_index = meta_index(start_meta, start);
+    struct region_meta *meta = start_meta;
+    size_t from = start_index;
+    size_t to = meta->count;
+
+    for( ;; ){
+        size_t i = meta_find(meta, from, to, size);
+        if( i < to ){
+            LOG("\t[✓] Found a block! size free: %zu\n", meta_free(meta, i));
+            return meta->blocks[i];
+        }
+        if( meta == start_meta && from == 0 ){
+            /* we have wrapped all the way around */
+            lock_release(&meta->lock);
+            break;
+        }
+
+        /* wrap around to the head once we fall off the end of the list */
+        struct mem_block *region = meta_next(meta);
+        lock_release(&meta->lock);
+        meta = region == NULL ? g_head->meta : region->meta;
+        lock_acquire(&meta->lock);
+        from = 0;
+        /* blocks are never removed from a live region, so the start index
+         * still lies within it */
+        to = meta == start_meta ? start_index : meta->count;
+    }
+
+    LOGP("\t[X] No reusable space\n");
+    return NULL;
+}
+
+/**
+ * Finds a reusable block with the configured FSM algorithm and splits it,
+ * returning it with its region still locked. Expects list_lock to be held
+ * (shared).
+ *
+ * @param size
+ */
+static void *reuse_locked(size_t size)
+{
+    LOGP("\t\t---- REUSE() ----\n");
+    LAT_START(search_start);
+
+    /* algo determines which FSM we will be using */
+    char *algo = getenv("ALLOCATOR_ALGORITHM");
+    if (algo == NULL) {
+        algo = "first_fit";
+    }
+
+    void *ptr = NULL;
+    if (strcmp(algo, "first_fit") == 0) {
+        ptr = first_fit(size);
+    } else if (strcmp(algo, "best_fit") == 0) {
+        ptr = best_fit(size);
+    } else if (strcmp(algo, "worst_fit") == 0) {
+        ptr = worst_fit(size);
+    } else if (strcmp(algo, "next_fit") == 0) {
+        ptr = next_fit(size);
+    } else {
+        return NULL;
+    }
+    STAT_ADD(searches, 1);
+
+    if(ptr != NULL){
+        struct mem_block *found = ptr;
+        ptr = split(found, size);
+        if(ptr == NULL){
+            /* no memory for the region's metadata */
+            lock_release(&found->region_start->meta->lock);
+        } else {
+            /* the next search resumes at the block we just handed out */
+            __atomic_store_n(&g_rover, ptr, __ATOMIC_RELAXED);
+        }
+    }
+
+    LAT_END(LAT_SEARCH, search_start);
+    return ptr;
+}
+
+/**
+ * Using free space management (FSM) algorithms, it finds a block of
+ * memory that we can reuse. It returns NULL if no suitable block is found.
+ * Expects list_lock to be held (shared); the block's region is locked only
+ * while it is split.
+ *
+ * @param size
+ */
+void *reuse(size_t size)
+{
+    struct mem_block *block = reuse_locked(size);
+    if(block != NULL){
+        lock_release(&block->region_start->meta->lock);
+    }
+    return block;
+}
+
+/**
+ * Converts a requested allocation size into a block size: the request plus
+ * the struct mem_block header, rounded up to 8 bytes.
+ *
+ * @param size
+ */
+static size_t block_size_for(size_t size)
+{
+    size += sizeof(struct mem_block);
+
+    /* resize size to be aligned to 8 bytes */
+    if(size % 8 != 0){
+        size = size + ( 8 - size % 8);
+    }
+    return size;
+}
+
+/**
+ * Picks the size of the next region. Rather than mapping just enough pages for
+ * the current request, regions start at region_min and double each time one
+ * is mapped, up to region_max; later allocations are carved out of the
+ * remainder. This keeps a stream of small allocations from costing one mmap()
+ * (and one VMA) per page. Requests larger than the next grown region get a
+ * region of their own and do not advance the growth. Configured with:
+ *
+ * ALLOCATOR_REGION_MIN=<bytes> (default: 65536; 0 maps exactly what is needed)
+ * ALLOCATOR_REGION_MAX=<bytes> (default: 4194304)
+ *
+ * @param region_sz
+ */
+static size_t grow_region_size(size_t region_sz)
+{
+    if (!region_configured) {
+        region_configured = true;
+        region_min = env_pages("ALLOCATOR_REGION_MIN", region_min);
+        region_max = env_pages("ALLOCATOR_REGION_MAX", region_max);
+        if (region_max < region_min) {
+            region_max = region_min;
+        }
+        g_next_region[0] = g_next_region[1] = region_min;
+    }
+
+    /* long-lived regions grow on their own, starting small again */
+    size_t *next = &g_next_region[life_long];
+    if (region_sz >= *next) {
+        return region_sz;
+    }
+
+    region_sz = *next;
+    *next = *next > region_max / 2 ? region_max : *next * 2;
+    return region_sz;
+}
+
+static void reclaim_memory(void);
+
+/**
+ * Picks the size of a new region for a request that needs region_sz bytes:
+ * normally the next grown size (see grow_region_size()). If that would cross
+ * a heap limit, the heap is trimmed first (see reclaim_memory()), and if it
+ * still would, the region is only as big as the request. A thread that leaves
+ * the heap past the soft limit will call the pressure callback once it has
+ * released list_lock (see notify_pressure()). Expects list_lock to be held
+ * exclusively.
+ *
+ * @param region_sz
+ */
+static size_t limit_region_size(size_t region_sz)
+{
+    load_limit_config();
+    size_t grown_sz = grow_region_size(region_sz);
+    if (!limit_exceeded(grown_sz)) {
+        return grown_sz;
+    }
+
+    LOG("\t[⚠️] Heap limit reached with %zu bytes mapped\n", g_mapped);
+    reclaim_memory();
+
+    size_t soft = __atomic_load_n(&soft_limit, __ATOMIC_RELAXED);
+    if (soft != 0 && __atomic_load_n(&g_mapped, __ATOMIC_RELAXED) + region_sz > soft) {
+        pressure_pending = true;
+    }
+    return limit_exceeded(grown_sz) ? region_sz : grown_sz;
+}
+
+/**
+ * Maps a new region of at least region_sz bytes (see limit_region_size()),
+ * places a block_sz block at its start and appends it to the end of the linked
+ * list (or makes it the head if the list is empty). If the new pages directly
+ * follow the last region inside the reservation, that region grows into them
+ * instead, so its free tail and the new space form one block; the new block is
+ * then split off that tail. Regions larger than region_max are never merged,
+ * so free() can still unmap a big allocation as soon as it is freed, and
+ * neither are short-lived regions while ALLOCATOR_LIFETIME is on, so each one
+ * can empty out on its own. Regions only merge within a lifetime class. Returns
+ * NULL if the region could not be mapped. Expects list_lock to be held
+ * exclusively.
+ *
+ * @param block_sz, region_sz
+ */
+static struct mem_block *add_region(size_t block_sz, size_t region_sz)
+{
+    LOGP("\tCreating new region...\n");
+    region_sz = limit_region_size(region_sz);
+    struct mem_block *block = (struct mem_block *) request(region_sz);
+
+    /* check if region was created */
+    if(block == NULL){
+        perror("request");
+        return NULL;
+    }
+
+    struct mem_block *last = g_head;
+    while(last != NULL && last->next != NULL){
+        last = last->next;
+    }
+
+    bool growable = reserve_owns(block) && region_sz <= region_max;
+    struct mem_block *start = last == NULL ? NULL : last->region_start;
+    if(growable && start != NULL && start->meta->growable
+            && start->meta->long_lived == life_long && (life_long || !life_enabled)
+            && (char *) start + start->region_size == (char *) block){
+        LOGP("\tGrowing the last region...\n");
+        start->region_size += region_sz;
+        last->size += region_sz;
+        meta_sync(last);
+        return split(last, block_sz);
+    }
+
+    /* populate the mem_block */
+    populate(block, block_sz, region_sz, block);
+    block->region_size = region_sz;
+    if(!meta_create(block)){
+        release(block, region_sz);
+        return NULL;
+    }
+    block->meta->growable = growable;
+    block->meta->long_lived = life_long;
+
+    if(g_head == NULL){
+        /* set new head */
+        g_head = block;
+        return block;
+    }
+
+    /* update linked list */
+    last->next = block;
+    return block;
+}
+
+/**
+ * Checks the ALLOCATOR_SCRIBBLE environment variable. If it is set to 1, new
+ * allocations are filled with 0xAA.
+ *
+ * @param void
+ */
+static void check_scribble(void)
+{
+    char *scribble = getenv("ALLOCATOR_SCRIBBLE");
+    LOG("\t[✍️] Scribble: %s\n", scribble);
+    if( scribble != NULL && atoi(scribble) == 1 ){
+        LOGP("\t[✍️] Scribbling Mode ON\n");
+        is_scribbling = true;
+    }
+}
+
+/**
+ * Fills a newly allocated block with 0xAA if scribbling mode is on. Only the
+ * usage bytes are filled: the free space behind them still belongs to the
+ * region, and another thread may split() a block out of it at any time.
+ *
+ * @param block
+ */
+static void scribble_block(struct mem_block *block)
+{
+    if( is_scribbling ){
+        LOGP("\t[✍️] Trying to scribble 0xAA\n");
+        size_t scrib_sz = block->usage - sizeof(struct mem_block);
+        bulk_fill(block + 1, 0xAA, scrib_sz);
+        LOGP("\t[✍️] Done!\n");
+    }
+}
+
+/**
+ * Returns true if ptr lies in the guarded sample pool. This is a single range
+ * comparison, so it is cheap enough to do on every free().
+ *
+ * @param ptr
+ */
+static bool guarded_owns(void *ptr)
+{
+    return guard_pool != NULL && (char *) ptr >= guard_pool
+        && (char *) ptr < guard_pool + guard_pool_size;
+}
+
+/**
+ * Writes a report about a fault in the guarded pool. The slot metadata tells
+ * us whether the access hit a freed slot (use-after-free) or a guard page
+ * right behind a live slot (overflow). Uses write() rather than stdio since it
+ * runs in a signal handler.
+ *
+ * @param addr
+ */
+static void guarded_report(char *addr)
+{
+    size_t page = (addr - guard_pool) / page_sz;
+    struct guard_slot *slot = NULL;
+    const char *kind;
+
+    if (page % 2 == 1) {
+        /* odd pages are slots */
+        slot = &guard_slots[page / 2];
+        kind = slot->freed ? "use-after-free" : "wild access";
+    } else if (page > 0 && guard_slots[page / 2 - 1].in_use) {
+        /* payloads end right at the guard page that follows their slot */
+        slot = &guard_slots[page / 2 - 1];
+        kind = "heap-buffer-overflow";
+    } else if (page / 2 < guard_num_slots && guard_slots[page / 2].in_use) {
+        slot = &guard_slots[page / 2];
+        kind = "heap-buffer-underflow";
+    } else {
+        kind = "wild access to guard page";
+    }
+
+    char buf[256];
+    int len;
+    if (slot != NULL) {
+        len = snprintf(buf, sizeof(buf),
+                "[GUARD] %s at %p: 'Allocation %lu' (%zu bytes), "
+                "allocated from %p\n", kind, (void *) addr, slot->alloc_id,
+                slot->size, slot->caller);
+    } else {
+        len = snprintf(buf, sizeof(buf), "[GUARD] %s at %p\n",
+                kind, (void *) addr);
+    }
+    if (len > 0) {
+        write(STDERR_FILENO, buf, len);
+    }
+}
+
+/**
+ * SIGSEGV handler for the guarded pool. After reporting a fault in the pool,
+ * the previous handler is restored and the faulting instruction re-executes,
+ * so the process still crashes (or the program's own handler runs) as usual.
+ *
+ * @param sig, info, context
+ */
+static void guarded_fault(int sig, siginfo_t *info, void *context)
+{
+    if (guarded_owns(info->si_addr)) {
+        guarded_report(info->si_addr);
+    }
+    sigaction(SIGSEGV, &guard_old_action, NULL);
+}
+
+/**
+ * Reads the sampling settings the first time they are needed and sets up the
+ * guarded pool:
+ *
+ * ALLOCATOR_SAMPLE_RATE=<n> sample about one in n allocations (default: 0, off)
+ * ALLOCATOR_SAMPLE_SLOTS=<n> number of guarded slots (default: 64)
+ *
+ * @param void
+ */
+static void load_sample_config(void)
+{
+    sample_configured = -1;
+
+    char *rate = getenv("ALLOCATOR_SAMPLE_RATE");
+    if (rate == NULL || (sample_rate = strtoul(rate, NULL, 10)) == 0) {
+        return;
+    }
+    char *slots = getenv("ALLOCATOR_SAMPLE_SLOTS");
+    if (slots != NULL && strtoul(slots, NULL, 10) > 0) {
+        guard_num_slots = strtoul(slots, NULL, 10);
+    }
+
+    /* every slot is surrounded by guard pages */
+    guard_pool_size = (2 * guard_num_slots + 1) * page_sz;
+    void *pool = mmap(NULL, guard_pool_size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    void *meta = mmap(NULL, guard_num_slots * sizeof(struct guard_slot),
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED || meta == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+    guard_slots = meta;
+
+    struct sigaction action = { 0 };
+    action.sa_sigaction = guarded_fault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &guard_old_action);
+
+    guard_pool = pool;
+    sample_configured = 1;
+    LOG("\t[🛡️] Sampling one in %lu allocations\n", sample_rate);
+}
+
+/**
+ * Decides whether this allocation should be sampled. Each thread counts down
+ * a random interval averaging sample_rate allocations, so no lock is needed.
+ *
+ * @param void
+ */
+static bool should_sample(void)
+{
+    if (sample_configured == 0) {
+        lock_acquire(&guard_lock);
+        if (sample_configured == 0) {
+            load_sample_config();
+        }
+        lock_release(&guard_lock);
+    }
+    if (sample_configured != 1) {
+        return false;
+    }
+
+    if (sample_countdown > 1) {
+        sample_countdown--;
+        return false;
+    }
+
+    /* xorshift: pick the next interval uniformly from [1, 2 * rate] */
+    if (sample_seed == 0) {
+        sample_seed = (unsigned long) &sample_seed ^ now_ms() ^ 0x9E3779B97F4A7C15UL;
+    }
+    sample_seed ^= sample_seed << 13;
+    sample_seed ^= sample_seed >> 7;
+    sample_seed ^= sample_seed << 17;
+    sample_countdown = 1 + sample_seed % (2 * sample_rate);
+    return true;
+}
+
+/**
+ * Places an allocation in its own page of the guarded pool, right-aligned so
+ * the byte after the payload (padded the same way as any other block) is the
+ * first byte of a PROT_NONE guard page. Overflows and, once the slot is freed, use-after-frees
+ * fault immediately and are reported by guarded_fault(). Slots are handed out
+ * round-robin so a freed slot stays inaccessible for as long as possible.
+ * Returns NULL if the request is too large or every slot is busy; the caller
+ * then falls back to a regular allocation.
+ *
+ * @param size, caller
+ */
+static void *guarded_malloc(size_t size, void *caller)
+{
+    /* same payload size a regular block would have, so usage stays exact */
+    size_t payload_sz = block_size_for(size) - sizeof(struct mem_block);
+    if (payload_sz + sizeof(struct mem_block) > page_sz) {
+        return NULL;
+    }
+
+    lock_acquire(&guard_lock);
+    size_t i;
+    for (i = 0; i < guard_num_slots; ++i) {
+        if (!guard_slots[(guard_next_slot + i) % guard_num_slots].in_use) {
+            break;
+        }
+    }
+    if (i == guard_num_slots) {
+        lock_release(&guard_lock);
+        return NULL;
+    }
+    size_t index = (guard_next_slot + i) % guard_num_slots;
+    guard_next_slot = index + 1;
+
+    char *page = guard_pool + (2 * index + 1) * page_sz;
+    if (mprotect(page, page_sz, PROT_READ | PROT_WRITE) == -1) {
+        lock_release(&guard_lock);
+        perror("mprotect");
+        return NULL;
+    }
+
+    struct mem_block *block =
+        (struct mem_block *) (page + page_sz - payload_sz) - 1;
+    populate(block, block_size_for(size), page + page_sz - (char *) block, block);
+    block->region_size = page_sz;
+
+    struct guard_slot *slot = &guard_slots[index];
+    slot->caller = caller;
+    slot->alloc_id = block->alloc_id;
+    slot->size = size;
+    slot->in_use = true;
+    slot->freed = false;
+    lock_release(&guard_lock);
+
+    STAT_ADD(sampled, 1);
+    LOG("\t[🛡️] Sampled allocation %lu in slot %zu\n", block->alloc_id, index);
+    return block + 1;
+}
+
+/**
+ * Frees a guarded allocation by making its whole slot inaccessible.
+ *
+ * @param ptr
+ */
+static void guarded_free(void *ptr)
+{
+    size_t index = ((char *) ptr - guard_pool) / page_sz / 2;
+    struct guard_slot *slot = &guard_slots[index];
+    char *page = guard_pool + (2 * index + 1) * page_sz;
+
+    lock_acquire(&guard_lock);
+    if (!slot->in_use) {
+        fprintf(stderr, "[GUARD] double free of %p: 'Allocation %lu' (%zu bytes)\n",
+                ptr, slot->alloc_id, slot->size);
+        abort();
+    }
+
+    LOG("\t[🛡️] Freeing sampled allocation %lu\n", slot->alloc_id);
+    struct mem_block *block = (struct mem_block *) ptr - 1;
+    tag_account(block, -tag_bytes(block), -1);
+    slot->in_use = false;
+    slot->freed = true;
+    if (mprotect(page, page_sz, PROT_NONE) == -1) {
+        perror("mprotect");
+    }
+    lock_release(&guard_lock);
+}
+
+/**
+ * Reads the lifetime settings from the environment (once, see
+ * life_predict()):
+ *
+ * ALLOCATOR_LIFETIME=1 turns lifetime-aware placement on
+ * ALLOCATOR_LIFETIME_THRESHOLD=<allocations> (default: 16384)
+ *
+ * @param void
+ */
+static void read_life_config(void)
+{
+    char *lifetime = getenv("ALLOCATOR_LIFETIME");
+    life_enabled = lifetime != NULL && atoi(lifetime) == 1;
+
+    char *threshold = getenv("ALLOCATOR_LIFETIME_THRESHOLD");
+    if (threshold != NULL && strtoul(threshold, NULL, 10) != 0) {
+        life_threshold = strtoul(threshold, NULL, 10);
+    }
+    __atomic_store_n(&life_configured, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the lifetime record of a block: region starts keep theirs in the
+ * region metadata, other blocks in their (otherwise unused) region_size.
+ *
+ * @param block
+ */
+static uint64_t life_get(struct mem_block *block)
+{
+    if (block == block->region_start) {
+        return block->meta == NULL ? 0 : block->meta->life;
+    }
+    return block->region_size;
+}
+
+/**
+ * Stores the lifetime record of a block (see life_get()).
+ *
+ * @param block, life
+ */
+static void life_set(struct mem_block *block, uint64_t life)
+{
+    if (block != block->region_start) {
+        block->region_size = life;
+    } else if (block->meta != NULL) {
+        block->meta->life = life;
+    }
+}
+
+/**
+ * Predicts whether the allocation being made from site will be long-lived,
+ * that is, outlive the next life_threshold allocations. Each call site
+ * (hashed from its return address) has a 2-bit saturating counter, trained
+ * by life_score() as its blocks are freed, and the prediction is its high
+ * bit. The prediction is left in life_long, where meta_find() and
+ * add_region() use it to keep long-lived blocks in regions of their own:
+ * short-lived regions then empty out completely and can be unmapped instead
+ * of being pinned by a few survivors. Returns the block's lifetime record, or
+ * 0 when ALLOCATOR_LIFETIME is off.
+ *
+ * @param site
+ */
+static uint64_t life_predict(void *site)
+{
+    if (!__atomic_load_n(&life_configured, __ATOMIC_ACQUIRE)) {
+        pthread_once(&life_once, read_life_config);
+    }
+    life_long = false;
+    if (!life_enabled) {
+        return 0;
+    }
+
+    uint64_t slot = ((uintptr_t) site * 0x9e3779b97f4a7c15ULL) >> (64 - LIFE_SITE_BITS);
+    life_long = __atomic_load_n(&life_sites[slot], __ATOMIC_RELAXED) >= 2;
+    uint64_t clock = __atomic_fetch_add(&g_life_clock, 1, __ATOMIC_RELAXED);
+    if (life_long) {
+        STAT_ADD(long_lived_allocs, 1);
+    }
+
+    return LIFE_VALID | (life_long ? LIFE_LONG : 0)
+        | slot << LIFE_CLOCK_BITS | (clock & LIFE_CLOCK_MASK);
+}
+
+/**
+ * Scores the prediction made for a block that is being freed and trains its
+ * call site's counter with the lifetime it actually had. Blocks without a
+ * record (made while the mode was off, or by malloc_batch()) are skipped.
+ *
+ * @param block
+ */
+static void life_score(struct mem_block *block)
+{
+    uint64_t life = life_get(block);
+    if (!(life & LIFE_VALID)) {
+        return;
+    }
+    life_set(block, 0);
+
+    uint64_t now = __atomic_load_n(&g_life_clock, __ATOMIC_RELAXED);
+    bool was_long = ((now - life) & LIFE_CLOCK_MASK) >= life_threshold;
+    STAT_ADD(lifetime_predictions, 1);
+    if (was_long == ((life & LIFE_LONG) != 0)) {
+        STAT_ADD(lifetime_correct, 1);
+    }
+
+    /* racing updates can lose a step, which only slows the training down */
+    uint8_t *counter = &life_sites[(life >> LIFE_CLOCK_BITS) & ((1 << LIFE_SITE_BITS) - 1)];
+    uint8_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    if (was_long && value < 3) {
+        __atomic_store_n(counter, value + 1, __ATOMIC_RELAXED);
+    } else if (!was_long && value > 0) {
+        __atomic_store_n(counter, value - 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Allocates memory by checking if you can reuse an existing block. 
+ * If not, it maps a new memory region. Returns the block's header; malloc()
+ * hands out the payload behind it. Callers inside the allocator that need
+ * the header take it from here rather than from malloc(), which the C
+ * library declares with the malloc attribute: the compiler takes its result
+ * for the start of a new object, so the header in front of it would be out
+ * of bounds. caller is the call site a sampled allocation reports and the
+ * lifetime prediction is made for, unless LIFE_CALLER() already set one.
+ * 
+ * @param size, caller
+ */
+static struct mem_block *malloc_block(size_t size, void *caller)
+{
+    LOGP("\t---- MALLOC() ----\n");
+
+    if(size <= 0){
+        return NULL;
+    }
+    LAT_START(op_start);
+
+    void *site = life_caller != NULL ? life_caller : caller;
+    life_caller = NULL;
+
+    if(should_sample()){
+        void *ptr = guarded_malloc(size, site);
+        if(ptr != NULL){
+            LAT_END(LAT_MALLOC, op_start);
+            return (struct mem_block *) ptr - 1;
+        }
+    }
+
+    /* create the size of the block, which includes the struct 
+     * at the beginning of the block. block_sz represents how 
+     * much of the region is being used (usage) */
+    size_t block_sz = block_size_for(size);
+    size_t region_sz = region_size_for(block_sz);
+
+    LOG("\t\tBlock size: %zu bytes\n", block_sz);
+    LOG("\t\tsize: %zu bytes\n", region_sz);
+
+    /* CHECK SCRIBBLING */ 
+    check_scribble();
+    /* picks long- or short-lived regions for the block */
+    uint64_t life = life_predict(site);
+
+    struct mem_block *block = NULL;
+    list_lock_shared();
+    LOGP("\t[🔒] list locked (shared)\n");
+    if(g_head == NULL){
+        /* this is the very first implementation: 0 regions, 0 blocks */
+        LOGP("\t\tThis is the first malloc() call.\n");
+    } else {
+        LOGP("\tChecking for reuse...\n");
+        /* we want to see if we can reuse any space */
+        block = (struct mem_block *) reuse(block_sz);
+    }
+    list_unlock_shared();
+
+    /* there is no reusable space so we need to create a new region */
+    if(block == NULL){
+        list_lock_exclusive();
+        LOGP("\t[🔒] list locked\n");
+        block = add_region(block_sz, region_sz);
+        list_unlock_exclusive();
+        if(pressure_pending){
+            notify_pressure();
+        }
+        if(block == NULL){
+            is_scribbling = false;
+            life_long = false;
+            errno = ENOMEM;
+            LAT_END(LAT_MALLOC, op_start);
+            return NULL;
+        }
+    }
+    life_long = false;
+
+    /* the block's usage bytes are ours now: no lock is needed to fill them
+     * (scribble_block() stays out of the free space behind them) */
+    life_set(block, life);
+    scribble_block(block);
+    is_scribbling = false;
+
+    /* RETURN POINTER */
+    LOGP("\t[🔑] unlocked\n");
+
+    LOGP("\t[✓] Successfully malloc() memory.\n\n");
+    LAT_END(LAT_MALLOC, op_start);
+    return block;
+}
+
+/**
+ * Allocates size bytes (see malloc_block()).
+ *
+ * @param size
+ */
+void *malloc(size_t size)
+{
+    struct mem_block *block = malloc_block(size, __builtin_return_address(0));
+    if(block == NULL){
+        return NULL;
+    }
+    /* returns block + 1 because block is pointing to the struct header not the data... I think */
+    return block + 1;
+}
+
+/**
+ * Allocates n blocks of the same size, locking once per region rather than
+ * once per block. Once a block has been found (or a region mapped), the
+ * following blocks are carved out of the free space right behind it with
+ * split() while its region stays locked, so most of the batch needs neither
+ * a reuse() scan nor an mmap(). If a new region is needed, it is sized for the
+ * rest of the batch. Returns the number of pointers stored in out, which is
+ * less than n only if memory ran out.
+ *
+ * @param size, n, out
+ */
+size_t malloc_batch(size_t size, size_t n, void **out)
+{
+    LOGP("\t---- MALLOC_BATCH() ----\n");
+
+    if(size == 0 || n == 0){
+        return 0;
+    }
+
+    size_t block_sz = block_size_for(size);
+    check_scribble();
+
+    list_lock_shared();
+    LOGP("\t[🔒] list locked (shared)\n");
+
+    size_t count = 0;
+    struct mem_block *prev = NULL; /* last block handed out; its region is locked */
+    while(count < n){
+        struct mem_block *block = NULL;
+
+        if(prev != NULL && prev->size - prev->usage >= block_sz){
+            /* carve the next block out of the space behind the last one */
+            block = split(prev, block_sz);
+            if(block == NULL){
+                /* no memory for the region's metadata */
+                break;
+            }
+        } else {
+            if(prev != NULL){
+                lock_release(&prev->region_start->meta->lock);
+                prev = NULL;
+            }
+            if(g_head != NULL){
+                block = (struct mem_block *) reuse_locked(block_sz);
+            }
+        }
+
+        if(block == NULL){
+            /* one region for everything that is left in the batch; adding
+             * it needs the list exclusively */
+            size_t remaining = n - count;
+            size_t batch_sz = remaining > SIZE_MAX / block_sz
+                ? block_sz : block_sz * remaining;
+            list_unlock_shared();
+            list_lock_exclusive();
+            block = add_region(block_sz, region_size_for(batch_sz));
+            list_unlock_exclusive();
+            if(block == NULL){
+                list_lock_shared();
+                break;
+            }
+            /* the region holds our block, so it cannot be unmapped while
+             * the list is unlocked */
+            list_lock_shared();
+            lock_acquire(&block->region_start->meta->lock);
+        }
+
+        scribble_block(block);
+        out[count++] = block + 1;
+        prev = block;
+    }
+    is_scribbling = false;
+
+    if(prev != NULL){
+        lock_release(&prev->region_start->meta->lock);
+    }
+    list_unlock_shared();
+    LOGP("\t[🔑] unlocked\n");
+    if(pressure_pending){
+        notify_pressure();
+    }
+    LOG("\t[✓] Successfully malloc_batch() %zu blocks.\n\n", count);
+    return count;
+}
+
+/**
+ * Allocates size bytes whose address is a multiple of alignment (a power of
+ * two). The block is over-allocated by alignment plus one header; if its
+ * payload is not already aligned, the aligned payload's header is placed
+ * inside the block and the leading part is left behind as a free block, the
+ * same way split() leaves free space behind a block.
+ *
+ * @param alignment, size
+ */
+static void *malloc_aligned(size_t alignment, size_t size)
+{
+    LOGP("\t---- MALLOC_ALIGNED() ----\n");
+
+    if(alignment <= 4){
+        /* every payload is at least 4-byte aligned */
+        return malloc(size);
+    }
+    if(size > SIZE_MAX - alignment - 2 * sizeof(struct mem_block) - 8){
+        life_caller = NULL;
+        return NULL;
+    }
+
+    /* enough for a whole aligned block anywhere past the leading header */
+    struct mem_block *block = malloc_block(block_size_for(size) + alignment,
+            __builtin_return_address(0));
+    if(block == NULL){
+        return NULL;
+    }
+
+    struct region_meta *meta = lock_region_of(block);
+    LOGP("\t[🔒] region locked\n");
+
+    if((uintptr_t) (block + 1) % alignment == 0){
+        /* already aligned: the over-allocation becomes the block's free
+         * space, so usage matches the size a sized free will pass */
+        block->usage = block_size_for(size);
+        meta_sync(block);
+        unlock_region(meta);
+        LOGP("\t[🔑] region unlocked\n");
+        return block + 1;
+    }
+
+    /* leave room for the leading block's header in front of the new one:
+     * the aligned payload is at most alignment - 1 bytes past block + 2,
+     * which keeps the aligned block inside the over-allocation (starting
+     * one header further in would overrun it) */
+    uintptr_t payload = (uintptr_t) (block + 2);
+    payload = (payload + alignment - 1) & ~(uintptr_t) (alignment - 1);
+
+    struct mem_block *aligned = (struct mem_block *) payload - 1;
+    size_t leading_sz = (void *) aligned - (void *) block;
+
+    if(!meta_reserve(meta)){
+        /* no memory to record the aligned block in the region's metadata:
+         * the whole block goes back to the region */
+        block->usage = 0;
+        block->freed_at = now_ms();
+        meta_sync(block);
+        unlock_region(meta);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    populate(aligned, block_size_for(size), block->size - leading_sz,
+            block->region_start);
+    aligned->next = block->next;
+    life_set(aligned, life_get(block));
+    life_set(block, 0);
+
+    /* the leading part becomes a free block */
+    block->size = leading_sz;
+    block->usage = 0;
+    block->freed_at = 0;
+    block->next = aligned;
+    meta_sync(block);
+    meta_insert(block, aligned);
+
+    unlock_region(meta);
+    LOGP("\t[🔑] region unlocked\n");
+    LOG("\t[✓] Successfully aligned %p to %zu bytes\n\n", aligned + 1, alignment);
+    return aligned + 1;
+}
+
+/**
+ * C11 aligned allocation.
+ *
+ * @param alignment, size
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0){
+        life_caller = NULL;
+        errno = EINVAL;
+        return NULL;
+    }
+    LIFE_CALLER();
+    return malloc_aligned(alignment, size);
+}
+
+/**
+ * POSIX aligned allocation. Returns 0 on success, EINVAL for a bad alignment
+ * or ENOMEM if no memory is available.
+ *
+ * @param memptr, alignment, size
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0){
+        return EINVAL;
+    }
+
+    LIFE_CALLER();
+    void *ptr = malloc_aligned(alignment, size);
+    if(ptr == NULL){
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+/**
+ * Obsolete aligned allocation, still used by some programs.
+ *
+ * @param alignment, size
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    LIFE_CALLER();
+    return aligned_alloc(alignment, size);
+}
+
+/**
+ * Writes the per-tag usage report to a file descriptor. Only snprintf() and
+ * write() are used, so this is safe to call from the dump signal handler.
+ *
+ * @param fd
+ */
+static void dump_tags(int fd)
+{
+    struct tag_stats stats[MAX_TAGS];
+    size_t count = get_tag_stats(stats, MAX_TAGS);
+    char line[160];
+    int len;
+
+    len = snprintf(line, sizeof(line), "[TAGS] %-32s %12s %10s %12s %12s\n",
+            "name", "live bytes", "live", "allocations", "peak bytes");
+    write(fd, line, len);
+    for (size_t i = 0; i < count; ++i) {
+        len = snprintf(line, sizeof(line), "[TAGS] %-32s %12ld %10ld %12lu %12ld\n",
+                stats[i].name, stats[i].live_bytes, stats[i].live_allocs,
+                stats[i].total_allocs, stats[i].peak_bytes);
+        write(fd, line, len);
+    }
+}
+
+/**
+ * Exit handler installed by ALLOCATOR_TAG_DUMP=1.
+ *
+ * @param void
+ */
+static void dump_tags_at_exit(void)
+{
+    dump_tags(STDERR_FILENO);
+}
+
+/**
+ * SIGUSR2 handler installed by ALLOCATOR_TAG_DUMP=1.
+ *
+ * @param sig
+ */
+static void dump_tags_on_signal(int sig)
+{
+    dump_tags(STDERR_FILENO);
+}
+
+/**
+ * Runs once, before the first tagged allocation: creates the key that hands
+ * an exited thread's counters on (see tag_release_thread()). With
+ * ALLOCATOR_TAG_DUMP=1, the per-tag report is written to stderr at exit and whenever the process
+ * receives SIGUSR2 (unless the program already handles SIGUSR2).
+ *
+ * @param void
+ */
+static void tag_init(void)
+{
+    pthread_key_create(&tag_key, tag_release_thread);
+
+    char *dump = getenv("ALLOCATOR_TAG_DUMP");
+    if (dump == NULL || atoi(dump) != 1) {
+        return;
+    }
+
+    atexit(dump_tags_at_exit);
+
+    struct sigaction old_action;
+    if (sigaction(SIGUSR2, NULL, &old_action) == 0
+            && old_action.sa_handler == SIG_DFL) {
+        struct sigaction action = { 0 };
+        action.sa_handler = dump_tags_on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR2, &action, NULL);
+    }
+}
+
+/**
+ * It is a version of malloc that allows customized memory block names. The
+ * name doubles as an accounting tag: live bytes, live and total allocations,
+ * and peak usage are tracked per distinct name (see get_tag_stats()).
+ *
+ * @param size, name
+ */
+void *malloc_name(size_t size, char *name)
+{
+    LOGP("\t---- MALLOC_NAME() ----\n");
+
+    pthread_once(&tag_once, tag_init);
+
+    struct mem_block *block = malloc_block(size, __builtin_return_address(0));
+    if (block == NULL) {
+        return NULL;
+    }
+
+    /* the block is ours until we return it, so renaming it needs no region
+    lock (write_memory() reads names without one; see its comment) */
+    snprintf(block->name, sizeof(block->name), "%s", name);
+    LOG("\tName: %s\n", block->name);
+
+    lock_acquire(&tag_lock);
+    block->tag = tag_intern(block->name);
+    lock_release(&tag_lock);
+    tag_account(block, tag_bytes(block), 1);
+
+    LOGP("\t[✓] Succesfully malloc_name()\n");
+    
+    return block + 1;
+}
+
+/**
+ * Reads the purge settings from the environment (once, see
+ * load_purge_config()):
+ *
+ * ALLOCATOR_PURGE=dontneed|free|off (default: dontneed)
+ * ALLOCATOR_PURGE_DECAY_MS=<ms> (default: 1000)
+ *
+ * @param void
+ */
+static void read_purge_config(void)
+{
+    char *advice = getenv("ALLOCATOR_PURGE");
+    if (advice != NULL && strcmp(advice, "off") == 0) {
+        purge_advice = -1;
+    } else if (advice != NULL && strcmp(advice, "free") == 0) {
+#ifdef MADV_FREE
+        purge_advice = MADV_FREE;
+#endif
+    }
+
+    char *decay = getenv("ALLOCATOR_PURGE_DECAY_MS");
+    if (decay != NULL) {
+        purge_decay_ms = strtoul(decay, NULL, 10);
+    }
+    g_last_purge = now_ms();
+    __atomic_store_n(&purge_configured, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Reads the purge settings the first time they are needed.
+ *
+ * @param void
+ */
+static void load_purge_config(void)
+{
+    if (!__atomic_load_n(&purge_configured, __ATOMIC_ACQUIRE)) {
+        pthread_once(&purge_once, read_purge_config);
+    }
+}
+
+/**
+ * Returns the number of bytes at the start of a block that purging leaves
+ * alone: its used bytes, or its header if the block is free.
+ *
+ * @param block
+ */
+static size_t purge_keep(struct mem_block *block)
+{
+    return block->usage > sizeof(struct mem_block)
+        ? block->usage : sizeof(struct mem_block);
+}
+
+/**
+ * Hands the whole pages of a block's free space back to the OS. The free
+ * space starts after the block's used bytes (or after its header, if the
+ * block is free), plus skip more bytes that stay resident, and runs to the end
+ * of the block; partial pages at either end are left alone. Returns the
+ * number of bytes purged.
+ *
+ * @param block, skip
+ */
+static size_t purge_block(struct mem_block *block, size_t skip)
+{
+    uintptr_t start = (uintptr_t) block + purge_keep(block) + skip;
+    uintptr_t end = (uintptr_t) block + block->size;
+
+    start = (start + page_sz - 1) & ~(uintptr_t) (page_sz - 1);
+    end &= ~(uintptr_t) (page_sz - 1);
+    block->freed_at = 0;
+    if (start >= end) {
+        return 0;
+    }
+
+    int ret = madvise((void *) start, end - start, purge_advice);
+    if (ret == -1 && errno == EINVAL && purge_advice != MADV_DONTNEED) {
+        /* MADV_FREE is not supported by older kernels */
+        purge_advice = MADV_DONTNEED;
+        ret = madvise((void *) start, end - start, purge_advice);
+    }
+    if (ret == -1) {
+        perror("madvise");
+        return 0;
+    }
+
+    STAT_ADD(purge_calls, 1);
+    STAT_ADD(purged_bytes, end - start);
+    return end - start;
+}
+
+/**
+ * Purges every block that has been free for at least min_age milliseconds.
+ * Pages that were freed more recently stay resident so a quick reuse does not
+ * have to fault them back in. Returns the number of bytes purged. Expects
+ * list_lock to be held exclusively.
+ *
+ * @param now, min_age
+ */
+static size_t purge_heap(unsigned long now, unsigned long min_age)
+{
+    LAT_START(purge_start);
+    size_t purged = 0;
+    struct mem_block *curr = g_head;
+
+    while (curr != NULL) {
+        if (curr->freed_at != 0 && now - curr->freed_at >= min_age
+                && !curr->region_start->meta->pinned) {
+            purged += purge_block(curr, 0);
+        }
+        curr = curr->next;
+    }
+    __atomic_store_n(&g_last_purge, now, __ATOMIC_RELAXED);
+    LAT_END(LAT_PURGE, purge_start);
+    return purged;
+}
+
+/**
+ * Runs purge_heap() if a full decay period has passed since the last sweep,
+ * so the cost of walking the heap is spread over many free() calls. The sweep
+ * takes list_lock exclusively, so it must not be held on entry.
+ *
+ * @param void
+ */
+static void maybe_purge(void)
+{
+    if (purge_advice == -1) {
+        return;
+    }
+
+    unsigned long now = now_ms();
+    if (now - __atomic_load_n(&g_last_purge, __ATOMIC_RELAXED) < purge_decay_ms) {
+        return;
+    }
+
+    list_lock_exclusive();
+    /* another thread may have swept while we waited */
+    if (now - g_last_purge >= purge_decay_ms) {
+        LOGP("\tPurging decayed free pages...\n");
+        purge_heap(now, purge_decay_ms);
+    }
+    list_unlock_exclusive();
+}
+
+/**
+ * Purges the free pages inside live regions right away, regardless of how
+ * recently they were freed. Besides freed blocks, this covers the free tail of
+ * blocks that were never freed, which split() leaves behind each allocation it
+ * carves out (the decayed sweep only looks at freed ones). Regions that are
+ * completely empty are already unmapped by free(), so there is no top of the
+ * heap to trim; instead, the first pad bytes of free space (in list order,
+ * where first fit looks first) stay resident. Returns 1 if any memory was
+ * released to the OS, 0 otherwise.
+ *
+ * @param pad
+ */
+int malloc_trim(size_t pad)
+{
+    LOGP("\t---- MALLOC_TRIM() ----\n");
+    load_purge_config();
+    list_lock_exclusive();
+
+    size_t purged = 0;
+    if (purge_advice != -1) {
+        LAT_START(purge_start);
+        for (struct mem_block *curr = g_head; curr != NULL; curr = curr->next) {
+            if (curr->region_start->meta->pinned) {
+                continue;
+            }
+            size_t space = curr->size - purge_keep(curr);
+            if (pad >= space) {
+                pad -= space;
+                continue;
+            }
+            purged += purge_block(curr, pad);
+            pad = 0;
+        }
+        g_last_purge = now_ms();
+        LAT_END(LAT_PURGE, purge_start);
+    }
+
+    list_unlock_exclusive();
+    LOG("\t[✓] Purged %zu bytes\n", purged);
+    return purged > 0;
+}
+
+/**
+ * Runs when the library is loaded and prepares the heap for latency-critical
+ * processes, so the first requests they serve do not pay for mmap() calls,
+ * page faults or reading the configuration:
+ *
+ * ALLOCATOR_PREWARM=<bytes> maps a region of that size up front and faults
+ *     its pages in (default: 0, off)
+ * ALLOCATOR_POPULATE=1 maps every later region with MAP_POPULATE
+ *
+ * The prewarmed region starts with a header-only block that is never freed,
+ * so the region is never unmapped and allocations are split off the rest of
+ * it; it is pinned so purging leaves its pages resident. A throwaway
+ * allocation then runs the lazy setup (algorithm, search kernel, sampling,
+ * purge settings) on the spot.
+ *
+ * @param void
+ */
+__attribute__((constructor))
+static void prewarm_heap(void)
+{
+    char *populate = getenv("ALLOCATOR_POPULATE");
+    if (populate != NULL && atoi(populate) == 1) {
+        map_populate = MAP_POPULATE;
+    }
+
+    size_t prewarm_sz = env_pages("ALLOCATOR_PREWARM", 0);
+    if (prewarm_sz == 0) {
+        return;
+    }
+
+    list_lock_exclusive();
+    struct mem_block *block = add_region(sizeof(struct mem_block), prewarm_sz);
+    struct mem_block *start = block == NULL ? NULL : block->region_start;
+    if (start != NULL) {
+        start->meta->pinned = true;
+        if (map_populate == 0) {
+            prefault(start, start->region_size);
+        }
+    }
+    list_unlock_exclusive();
+
+    if (start != NULL) {
+        free(malloc(1));
+        LOG("\t[🔥] Prewarmed %zu bytes\n", start->region_size);
+    }
+}
+
+/**
+ * Unmaps a chain of queued regions.
+ *
+ * @param region
+ */
+static void unmap_queued(struct mem_block *region)
+{
+    while (region != NULL) {
+        struct mem_block *next = region->next;
+        if (release(region, region->region_size) == -1) {
+            perror("munmap");
+        } else {
+            STAT_ADD(munmap_calls, 1);
+            LOGP("\t[✓] Region has been unmapped\n");
+        }
+        region = next;
+    }
+}
+
+/**
+ * Body of the reclaimer thread: sleeps until regions are queued, then unmaps
+ * everything in the queue as one batch.
+ *
+ * @param arg
+ */
+static void *reclaimer_main(void *arg)
+{
+    pthread_mutex_lock(&unmap_mutex);
+    for (;;) {
+        while (unmap_queue == NULL) {
+            pthread_cond_wait(&unmap_cond, &unmap_mutex);
+        }
+        struct mem_block *queue = unmap_queue;
+        unmap_queue = NULL;
+
+        pthread_mutex_unlock(&unmap_mutex);
+        unmap_queued(queue);
+        pthread_mutex_lock(&unmap_mutex);
+    }
+    return NULL;
+}
+
+/**
+ * fork() prepare handler: takes every allocator lock, in lock order, so that
+ * no other thread is in the middle of changing the heap when the child's copy
+ * of it is made. The child has only the forking thread, and a lock held by
+ * any other one would never be released there.
+ *
+ * @param void
+ */
+static void atfork_prepare(void)
+{
+    list_lock_exclusive();
+    lock_acquire(&guard_lock);
+    lock_acquire(&tag_lock);
+    lock_acquire(&stat_lock);
+    lock_acquire(&meta_lock);
+    lock_acquire(&reserve_lock);
+    pthread_mutex_lock(&unmap_mutex);
+#if LATENCY
+    pthread_mutex_lock(&lat_mutex);
+#endif
+}
+
+/**
+ * fork() parent handler: releases what atfork_prepare() took.
+ *
+ * @param void
+ */
+static void atfork_parent(void)
+{
+#if LATENCY
+    pthread_mutex_unlock(&lat_mutex);
+#endif
+    pthread_mutex_unlock(&unmap_mutex);
+    lock_release(&reserve_lock);
+    lock_release(&meta_lock);
+    lock_release(&stat_lock);
+    lock_release(&tag_lock);
+    lock_release(&guard_lock);
+    list_unlock_exclusive();
+}
+
+/**
+ * fork() child handler: releases the locks like the parent does. A reader
+ * may have been between counting itself in a list_lock slot and stepping
+ * back from the writer when the memory was copied; it does not exist in the
+ * child, so the slots are cleared. The reclaimer thread does not survive
+ * fork() either, so the child goes back to unmapping inline.
+ *
+ * @param void
+ */
+static void atfork_child(void)
+{
+    for (size_t i = 0; i < LIST_SLOTS; ++i) {
+        list_slots[i].readers = 0;
+    }
+    reclaimer_running = false;
+    atfork_parent();
+}
+
+/**
+ * Registers the fork() handlers when the library is loaded.
+ *
+ * @param void
+ */
+__attribute__((constructor))
+static void atfork_init(void)
+{
+    pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+/**
+ * Starts the reclaimer thread if ALLOCATOR_RECLAIMER=1. It blocks all
+ * signals, so it never runs a handler in the middle of an munmap() batch.
+ * pthread_create() may call back into malloc() and free(), so this is not
+ * guarded with pthread_once(): a free() made while the thread is being
+ * started simply unmaps inline.
+ *
+ * @param void
+ */
+static void start_reclaimer(void)
+{
+    int state = 0;
+    if (!__atomic_compare_exchange_n(&reclaimer_configured, &state, 1, false,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    char *reclaimer = getenv("ALLOCATOR_RECLAIMER");
+    if (reclaimer == NULL || atoi(reclaimer) != 1) {
+        __atomic_store_n(&reclaimer_configured, 2, __ATOMIC_RELEASE);
+        return;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, reclaimer_main, NULL) == 0) {
+        reclaimer_running = true;
+        LOGP("\t[♻️] Started the reclaimer thread\n");
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+    __atomic_store_n(&reclaimer_configured, 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Queues an unlinked region for munmap(). munmap() is a slow system call (it
+ * has to shoot down the TLB entries on every core), so it is not done while
+ * list_lock is held: every other thread would stall behind it. The region's
+ * metadata is released right away; the region itself is unmapped by
+ * release_unmapped() once the lock has been dropped. Expects list_lock to be
+ * held exclusively.
+ *
+ * @param start
+ */
+static void defer_unmap(struct mem_block *start)
+{
+    meta_destroy(start);
+
+    pthread_mutex_lock(&unmap_mutex);
+    start->next = unmap_queue;
+    unmap_queue = start;
+    pthread_mutex_unlock(&unmap_mutex);
+}
+
+/**
+ * Unmaps the regions queued by defer_unmap(). Must be called without
+ * list_lock held. With ALLOCATOR_RECLAIMER=1, a background thread does the
+ * unmapping in batches and this only wakes it; otherwise the calling thread
+ * unmaps everything in the queue itself.
+ *
+ * @param void
+ */
+static void release_unmapped(void)
+{
+    if (reclaimer_configured == 0) {
+        start_reclaimer();
+    }
+    if (reclaimer_running) {
+        pthread_cond_signal(&unmap_cond);
+        return;
+    }
+
+    pthread_mutex_lock(&unmap_mutex);
+    struct mem_block *queue = unmap_queue;
+    unmap_queue = NULL;
+    pthread_mutex_unlock(&unmap_mutex);
+
+    unmap_queued(queue);
+}
+
+/**
+ * Unmaps a region if all of its blocks are free, unlinking it from the list.
+ * The caller found the region empty under its region lock, but had to let go
+ * of it to take list_lock exclusively (which must be held here), so the
+ * region may have been refilled or already unmapped in the meantime; both
+ * are checked again. The region is only queued for munmap() here; see
+ * defer_unmap().
+ *
+ * @param start
+ */
+static void unmap_region(struct mem_block *start)
+{
+    /* Cases:
+     * 1. single region (reset head)
+     * 2. multiple regions, free first (reset head)
+     * 3. two regions, free second (connect head region to null)
+     * 4. multiple regions, free middle (connect prev region to next)
+    */
+
+    /* find the last block of the previous region (NULL: start is the head) */
+    struct mem_block *prev = NULL;
+    struct mem_block *region = g_head;
+    while( region != NULL && region != start ){
+        prev = region->meta->blocks[region->meta->count - 1];
+        region = prev->next;
+    }
+    if( region == NULL || !meta_empty(start->meta) ){
+        return;
+    }
+
+    /* curr is either null or the first block of the adjacent region */
+    struct mem_block *curr = meta_next(start->meta);
+    if( prev == NULL ){
+        LOGP("\tResetting head...\n");
+        /* cases 1 & 2: if the head is being reset, all we have to do is set the head
+        to curr which could be null or another region, no connecting needed */
+        g_head = curr;
+    } else {
+        /* cases 3 & 4: connect the previous region to either null (case 3)
+        or the next region (case 4) */
+        prev->next = curr;
+    }
+
+    /* the rover must not point into a region we are about to unmap */
+    if( g_rover != NULL && g_rover->region_start == start ){
+        g_rover = curr;
+    }
+    defer_unmap(start);
+}
+
+/**
+ * Deallocates/frees memory by resetting a block's usage to 0.
+ * If an entire region's block usage is 0, it unmaps the memory region.
+ * Only the block's region is locked while the block is freed; unmapping an
+ * empty region takes the whole list.
+ *
+ * @param ptr
+ */
+void free(void *ptr)
+{   
+    LOGP("\t---- FREE() ----\n"); 
+
+    if (ptr == NULL) {
+        /* Freeing a NULL pointer does nothing */
+        LOGP("\t[X] NULL ptr was passed.\n");
+        return;
+    }
+
+    LAT_START(op_start);
+    if (guarded_owns(ptr)) {
+        guarded_free(ptr);
+        LAT_END(LAT_FREE, op_start);
+        return;
+    }
+
+    load_purge_config();
+
+    /* set that block's usage to zero */
+    struct mem_block *block = (struct mem_block *) ptr - 1;
+    struct mem_block *start = block->region_start;
+    struct region_meta *meta = lock_region_of(block);
+    LOGP("\t[🔒] region locked\n");
+
+    LOG("\t\tFreeing alloc id: %lu\n", block->alloc_id);
+    tag_account(block, -tag_bytes(block), -1);
+    life_score(block);
+    block->usage = 0;
+    meta_sync(block);
+    block->freed_at = now_ms();
+    LOGP("\t\tAfter freeing:\n");
+    print_block(block);
+
+    /* CHECKING FOR EMPTY REGION */
+    bool region_empty = meta_empty(meta);
+    unlock_region(meta);
+    LOGP("\t[🔑] region unlocked\n");
+
+    if( region_empty ){
+        list_lock_exclusive();
+        LOGP("\t[🔒] list locked\n");
+        unmap_region(start);
+        list_unlock_exclusive();
+        LOGP("\t[🔑] list unlocked\n");
+        release_unmapped();
+    } else {
+        maybe_purge();
+    }
+    LAT_END(LAT_FREE, op_start);
+    LOGP("\t[✓] Succesfully free()\n");
+}
+
+/**
+ * Walks the linked list once, region by region, and unmaps every region whose
+ * blocks are all free. This is the batched form of the region-empty check in
+ * free(). Expects list_lock to be held exclusively.
+ *
+ * @param void
+ */
+static void unmap_empty_regions(void)
+{
+    struct mem_block *prev = NULL; /* last block of the previous kept region */
+    struct mem_block *curr = g_head;
+
+    while(curr != NULL){
+        struct mem_block *start = curr;
+        struct mem_block *last = curr;
+        bool region_empty = true;
+
+        while(curr != NULL && curr->region_start == start){
+            if(curr->usage != 0){
+                region_empty = false;
+            }
+            last = curr;
+            curr = curr->next;
+        }
+
+        if(!region_empty){
+            prev = last;
+            continue;
+        }
+
+        /* curr is now null or the first block of the next region */
+        if(prev == NULL){
+            g_head = curr;
+        } else {
+            prev->next = curr;
+        }
+        if(g_rover != NULL && g_rover->region_start == start){
+            g_rover = curr;
+        }
+        defer_unmap(start);
+    }
+}
+
+/**
+ * Gives as much memory back to the OS as possible without touching live
+ * blocks: empty regions are unmapped (including ones queued for the
+ * reclaimer, right away), and the free pages of every other region are
+ * purged regardless of the decay. Called when a heap limit is reached.
+ * Expects list_lock to be held exclusively.
+ *
+ * @param void
+ */
+static void reclaim_memory(void)
+{
+    STAT_ADD(pressure_events, 1);
+    unmap_empty_regions();
+
+    pthread_mutex_lock(&unmap_mutex);
+    struct mem_block *queue = unmap_queue;
+    unmap_queue = NULL;
+    pthread_mutex_unlock(&unmap_mutex);
+    unmap_queued(queue);
+
+    load_purge_config();
+    if (purge_advice != -1) {
+        purge_heap(now_ms(), 0);
+    }
+}
+
+/**
+ * Frees n blocks, locking each region once for a run of blocks that belong to
+ * it. All of the blocks are marked free first; if that left any region empty,
+ * the regions are checked for emptiness in one pass over the list rather than
+ * once per block. NULL entries are skipped.
+ *
+ * @param ptrs, n
+ */
+void free_batch(void **ptrs, size_t n)
+{
+    LOGP("\t---- FREE_BATCH() ----\n");
+    load_purge_config();
+    unsigned long now = now_ms();
+    bool any_empty = false;
+
+    list_lock_shared();
+    LOGP("\t[🔒] list locked (shared)\n");
+
+    struct region_meta *locked = NULL;
+    for(size_t i = 0; i < n; ++i){
+        if(ptrs[i] == NULL){
+            continue;
+        }
+        if(guarded_owns(ptrs[i])){
+            guarded_free(ptrs[i]);
+            continue;
+        }
+        struct mem_block *block = (struct mem_block *) ptrs[i] - 1;
+        struct region_meta *meta = block->region_start->meta;
+        if(meta != locked){
+            if(locked != NULL){
+                any_empty = any_empty || meta_empty(locked);
+                lock_release(&locked->lock);
+            }
+            lock_acquire(&meta->lock);
+            locked = meta;
+        }
+        LOG("\t\tFreeing alloc id: %lu\n", block->alloc_id);
+        tag_account(block, -tag_bytes(block), -1);
+        life_score(block);
+        block->usage = 0;
+        block->freed_at = now;
+        meta_sync(block);
+    }
+    if(locked != NULL){
+        any_empty = any_empty || meta_empty(locked);
+        lock_release(&locked->lock);
+    }
+    list_unlock_shared();
+
+    if(any_empty){
+        list_lock_exclusive();
+        unmap_empty_regions();
+        list_unlock_exclusive();
+        release_unmapped();
+    }
+    maybe_purge();
+    LOGP("\t[🔑] unlocked\n");
+    LOGP("\t[✓] Succesfully free_batch()\n");
+}
+
+/**
+ * Returns true if ALLOCATOR_DEBUG is set to 1. In debug mode, the sizes passed
+ * to the sized deallocation functions are checked against the block headers.
+ *
+ * @param void
+ */
+static bool debugging(void)
+{
+    if(is_debugging == -1){
+        char *debug = getenv("ALLOCATOR_DEBUG");
+        is_debugging = debug != NULL && atoi(debug) == 1;
+    }
+    return is_debugging;
+}
+
+/**
+ * Aborts with a report if a sized free does not match the block it frees.
+ *
+ * @param func, ptr, alignment, size
+ */
+static void check_sized_free(const char *func, void *ptr, size_t alignment, size_t size)
+{
+    struct mem_block *block = (struct mem_block *) ptr - 1;
+
+    if(block->usage == 0){
+        fprintf(stderr, "%s(%p): double free of '%s'\n", func, ptr, block->name);
+        abort();
+    }
+    if(block_size_for(size) != block->usage){
+        fprintf(stderr, "%s(%p): size %zu does not match '%s' (holds %zu bytes)\n",
+                func, ptr, size, block->name,
+                block->usage - sizeof(struct mem_block));
+        abort();
+    }
+    if(alignment != 0 && (uintptr_t) ptr % alignment != 0){
+        fprintf(stderr, "%s(%p): pointer is not %zu-byte aligned\n",
+                func, ptr, alignment);
+        abort();
+    }
+}
+
+/**
+ * C23 sized deallocation: frees a block that the caller knows was allocated
+ * with size bytes. There are no size classes to look up here: every free
+ * already starts from the block header, and the region-empty check depends
+ * on the other blocks rather than this one's size, so the hint does not make
+ * the free any cheaper. It is only validated, when ALLOCATOR_DEBUG=1.
+ *
+ * @param ptr, size
+ */
+void free_sized(void *ptr, size_t size)
+{
+    if(ptr != NULL && debugging()){
+        check_sized_free("free_sized", ptr, 0, size);
+    }
+    free(ptr);
+}
+
+/**
+ * C23 sized deallocation for blocks from aligned_alloc(). As with
+ * free_sized(), the hints are not used to free the block; when
+ * ALLOCATOR_DEBUG=1, both the size and the alignment are checked.
+ *
+ * @param ptr, alignment, size
+ */
+void free_aligned_sized(void *ptr, size_t alignment, size_t size)
+{
+    if(ptr != NULL && debugging()){
+        check_sized_free("free_aligned_sized", ptr, alignment, size);
+    }
+    free(ptr);
+}
+
+/**
+ * Allocates initialized memory space. Returns NULL (with errno set to ENOMEM)
+ * if nmemb * size does not fit in a size_t.
+ *
+ * @param nmemb, size
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    LOGP("\t---- CALLOC() ----\n");
+
+    LOG("\t\tCalloc request: %zu members of size %zu bytes\n", nmemb, size);
+
+    size_t total;
+    if (__builtin_mul_overflow(nmemb, size, &total)) {
+        LOGP("\t[X] Request size overflows\n");
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* malloc with the number of members * size of members */
+    LIFE_CALLER();
+    void *ptr = malloc(total);
+    /* initialize everything to 0 */
+    if (ptr != NULL) {
+        bulk_fill(ptr, 0x00, total);
+    }
+
+    /* return the pointer to the callocd memory (region?/block?) */
+    LOG("\t[✓] Successful calloc() memory to %p\n\n", ptr);
+    
+    return ptr;
+}
+
+/**
+ * Resizes a region of memory by creating a new memory block 
+ * and copying the old memory into the new memory block.
+ *
+ * @param ptr, size
+ */
+void *realloc(void *ptr, size_t size)
+{
+    LOGP("\t---- REALLOC() -------------------------------\n");
+
+    size_t check_size = size + sizeof(struct mem_block);
+    if(check_size % 8 != 0){
+        check_size = check_size + ( 8 - check_size % 8);
+    }
+
+
+    if( ptr == NULL ){
+        /* If the pointer is NULL, then we simply malloc a new block */
+        LIFE_CALLER();
+        return malloc(size);
+    }
+
+    if( size == 0 ) {
+        /* Realloc to 0 is often the same as freeing the memory block... But the
+         * C standard doesn't require this. We will free the block and return
+         * NULL here. */
+        free(ptr);
+        return NULL;
+    }
+
+    LAT_START(op_start);
+    struct mem_block* curr = (struct mem_block*)ptr - 1;
+    struct region_meta *meta = lock_region_of(curr);
+    LOGP("\t[🔒] region locked\n");
+    //if( curr->size >= size)
+    if( curr->size >= check_size ){
+        /* Size provided is too small to realloc */
+        tag_account(curr, (long) check_size - (long) curr->usage, 0);
+        curr->usage = check_size;
+        meta_sync(curr);
+        unlock_region(meta);
+        LOGP("\t[🔑] region unlocked\n");
+        LAT_END(LAT_REALLOC, op_start);
+        return ptr;
+    }
+
+    /* Time to realloc by malloc-ing new space and free old space.
+     * Then, we will copy the old data into the new space. */
+    unlock_region(meta);
+    LOGP("\t[🔑] region unlocked\n");
+    struct mem_block *new_block = malloc_block(size, __builtin_return_address(0));
+    if( !new_block ){
+        perror("malloc");
+        return NULL;
+    }
+    void *new_ptr = new_block + 1;
+    bulk_copy(new_ptr, ptr, curr->usage - sizeof(struct mem_block));
+
+    if( curr->tag != 0 ){
+        /* the new block keeps the old one's name and tag */
+        snprintf(new_block->name, sizeof(new_block->name), "%s", curr->name);
+        new_block->tag = curr->tag;
+        tag_account(new_block, tag_bytes(new_block), 1);
+    }
+    free(ptr); 
+
+    LOG("\t[✓]Successfully realloc() memory to %p\n\n", new_ptr);
+    LAT_END(LAT_REALLOC, op_start);
+    return new_ptr;
+}
+
+/**
+ * Maps a region of at least size bytes for an arena, using request() like the
+ * main heap does. Returns NULL if the region could not be mapped.
+ *
+ * @param size
+ */
+static struct arena_chunk *arena_chunk_new(size_t size)
+{
+    size = region_size_for(size);
+
+    struct arena_chunk *chunk = request(size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    STAT_ADD(arena_bytes, size);
+    chunk->next = NULL;
+    chunk->size = size;
+    return chunk;
+}
+
+/**
+ * Makes chunk the region that allocations are bumped from.
+ *
+ * @param arena, chunk
+ */
+static void arena_use(struct arena *arena, struct arena_chunk *chunk)
+{
+    arena->curr = chunk;
+    arena->bump = (char *) (chunk + 1);
+    if (chunk == arena->first) {
+        arena->bump = (char *) (arena + 1);
+    }
+    arena->end = (char *) chunk + chunk->size;
+}
+
+/**
+ * Creates an arena whose first region is at least region_sz bytes (0 picks
+ * the default, 64 KiB). Later regions double in size, up to 4 MiB. Returns
+ * NULL if no memory is available.
+ *
+ * @param region_sz
+ */
+struct arena *arena_create(size_t region_sz)
+{
+    LOGP("\t---- ARENA_CREATE() ----\n");
+
+    if (region_sz == 0) {
+        region_sz = ARENA_MIN_REGION;
+    }
+    if (region_sz > SIZE_MAX - page_sz) {
+        return NULL;
+    }
+
+    struct arena_chunk *chunk = arena_chunk_new(region_sz);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    struct arena *arena = (struct arena *) (chunk + 1);
+    arena->first = chunk;
+    arena->next_size = chunk->size < ARENA_MAX_REGION / 2
+        ? chunk->size * 2 : ARENA_MAX_REGION;
+    if (arena->next_size < chunk->size) {
+        arena->next_size = chunk->size;
+    }
+    arena_use(arena, chunk);
 
-pthread_mutex_t alloc_mutex = PTHREAD_MUTEX_INITIALIZER; /*< Mutex for protecting the linked list */
+    LOG("\t[✓] Created arena %p (%zu bytes)\n", arena, chunk->size);
+    return arena;
+}
 
 /**
- * A simple LOG function to LOG contents of a struct mem_block.
+ * Allocates size bytes from an arena, aligned to alignment (a power of two).
+ * This bumps a pointer through the current region; when it runs out, the
+ * arena moves on to its next region, mapping one if it has none left (a
+ * region kept by arena_reset() is reused if the request fits). Arena
+ * allocations must not be passed to free() or realloc(): they are released
+ * all at once by arena_reset() or arena_destroy(). An arena is not locked,
+ * so each one should only be used by one thread at a time. Returns NULL if
+ * no memory is available or alignment is not a power of two.
  *
- * @param block
+ * @param arena, alignment, size
  */
-void print_block(struct mem_block *block){
-    LOG("\t\talloc_id: %lu\n", block->alloc_id);
-    LOG("\t\tblock_name: %s\n", block->name);
-    LOG("\t\tblock_size: %zu\n", block->size);
-    LOG("\t\tblock_usage: %zu\n", block->usage); 
+void *arena_memalign(struct arena *arena, size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    for (;;) {
+        uintptr_t ptr = ((uintptr_t) arena->bump + alignment - 1)
+            & ~(uintptr_t) (alignment - 1);
+        if (ptr >= (uintptr_t) arena->bump && ptr <= (uintptr_t) arena->end
+                && size <= (uintptr_t) arena->end - ptr) {
+            arena->bump = (char *) ptr + size;
+            return (void *) ptr;
+        }
+
+        /* worst case for a fresh region: its header plus alignment padding */
+        if (size > SIZE_MAX - alignment - sizeof(struct arena_chunk) - page_sz) {
+            return NULL;
+        }
+        size_t needed = size + alignment + sizeof(struct arena_chunk);
+
+        struct arena_chunk *next = arena->curr->next;
+        if (next != NULL && next->size >= needed) {
+            arena_use(arena, next);
+            continue;
+        }
+
+        /* map a new region after the current one; any regions kept by
+         * arena_reset() that are too small stay behind it */
+        size_t chunk_sz = needed > arena->next_size ? needed : arena->next_size;
+        struct arena_chunk *chunk = arena_chunk_new(chunk_sz);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        if (needed <= arena->next_size) {
+            arena->next_size = arena->next_size > ARENA_MAX_REGION / 2
+                ? ARENA_MAX_REGION : arena->next_size * 2;
+        }
+        chunk->next = next;
+        arena->curr->next = chunk;
+        arena_use(arena, chunk);
+    }
 }
 
 /**
- * If the current region has no reusable space, this requests space from the OS 
- * using mmap() and adds the new block to the end of the linked list.
+ * Allocates size bytes from an arena, aligned for any type (16 bytes). See
+ * arena_memalign().
  *
- * @param region_sz
+ * @param arena, size
  */
-void *request(size_t region_sz){
-    LOGP("\t---- REQUEST() ----\n");
-    /* note that we are mmaping region_sz */
-    void *block = mmap(NULL, region_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-
-    /* error checking */
-    if(block == MAP_FAILED){
-        perror("mmap");
-        return NULL;
-    }
-    LOGP("\t[✓] Successfully request() memory.\n");
-    return block;
+void *arena_malloc(struct arena *arena, size_t size)
+{
+    return arena_memalign(arena, ARENA_ALIGNMENT, size);
 }
 
 /**
- * Populates any given mem_block struct.
+ * Releases every allocation made from an arena in O(1) by rewinding it to
+ * the start of its first region. The regions stay mapped and are reused by
+ * later allocations.
  *
- * @param block, requested_sz, block_sz, start
+ * @param arena
  */
-void populate(struct mem_block *block, size_t requested_sz, size_t block_sz, struct mem_block *start){
-    LOGP("\t---- POPULATE() ----\n");
-    /* each allocation will increment g_allocations by one and represent the alloc_id */
-    block->alloc_id = g_allocations++;
-    /* naming each block */
-    sprintf(block->name, "Allocation %lu", block->alloc_id);
-    /* block.size should represent the size of the block */
-    block->size = block_sz;
-    /* block.usage represents how much of the region is being used by the block, AKA block_sz */
-    block->usage = requested_sz;
-    /* block.region_start should point to the beginning of the mapped region */
-    block->region_start = start;
-    /* each new block will be added to the end of the region so next should be NULL */
-    block->next = NULL;
-    //print_block(block);
-    LOGP("\t[✓] Successfully populate() memory\n");
+void arena_reset(struct arena *arena)
+{
+    arena_use(arena, arena->first);
 }
 
 /**
- * Creates a block and adds it to linked list by splitting avaliable block
+ * Unmaps every region of an arena, releasing the arena and all of its
+ * allocations.
  *
- * @param block, size
+ * @param arena
  */
-void *split(void *block, size_t size){
-    /* we can assume the block given to us is big enough */
-
-    LOGP("\t\t---- SPLIT() ----\n");
-
-    struct mem_block *curr = block;
-    struct mem_block *new = NULL;
-
-    if( curr->usage == 0 ){
-        LOG("\t\tUpdating block (alloc_id): %lu\n", curr->alloc_id);
-        /* we just want to update the block's usage */
-        curr->usage = size;
-        return curr;
+void arena_destroy(struct arena *arena)
+{
+    if (arena == NULL) {
+        return;
     }
 
-    /* SPLITTING THE BLOCK */
-
-    LOG("\t\tSplitting block (alloc_id): %lu\n", curr->alloc_id);
-    /* update the curr size */
-    size_t new_block_sz = curr->size;
-    curr->size = curr->usage;
-    new_block_sz -= curr->usage;
-    new = (void *)curr + curr->size; /* includes sizeof(struct mem_block) */
-    /* populate new mem_block */
-    populate(new, size, new_block_sz, curr->region_start);
+    LOG("\t[🗑️] Destroying arena %p\n", arena);
+    struct arena_chunk *chunk = arena->first;
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+        size_t size = chunk->size;
+        release(chunk, size);
+        STAT_ADD(munmap_calls, 1);
+        STAT_ADD(arena_bytes, -size);
 
-    /* case where we split in the middle */
-    if( curr->next != NULL ){ 
-        /* update linked list */
-        new->next = curr->next;
+        chunk = next;
     }
-    curr->next = new;
-    
-    LOGP("\t\t[✓] Successfully split() block.\n");
-    return new;
 }
 
 /**
- * Using the first fit FSM implementation, it reuses free memory in a region
- * by finding the first, suitable memory block.
+ * Returns the block at offset off of a persistent heap.
  *
- * @param size
+ * @param heap, off
  */
-void *first_fit(size_t size)
+static struct pheap_block *pheap_block_at(struct pheap *heap, uint64_t off)
 {
-    LOGP("\t---- FIRST_FIT() ----\n");
-    struct mem_block *curr = g_head;
-    /* We want to keep searching until we find a block that is free 
-    * and large enough */
-    while( curr != NULL ){  
-        /* case where block is partially free */
-        if( (curr->size - curr->usage) >= size ){
-            LOG("\t[✓] Found a block! size free: %zu\n", curr->size - curr->usage);
-            /* returns a pointer of first half of block to be split */
-            return curr;
-        }
-    
-        if( curr->next == NULL){
-            LOGP("\t[X] No reusable space\n");
-            return NULL;
-        }
-        curr = curr->next;
-    }
-    return NULL;
+    return (struct pheap_block *) (heap->base + off);
 }
 
 /**
- * Using the worst fit FSM implementation, it reuses free memory in a region
- * by finding the largest continuous memory block.
+ * Sets up the lock of a heap as a process-shared mutex, so that every process
+ * mapping the heap can take it. It is also robust: if a process dies holding
+ * it, the next one to lock it is told so instead of waiting forever.
  *
- * @param size
+ * @param header
  */
-void *worst_fit(size_t size)
+static void pheap_lock_init(struct pheap_header *header)
 {
-    LOGP("\t---- WORST_FIT() ----\n");
-    struct mem_block *curr = g_head;
-    struct mem_block *worst = NULL;
-    size_t worst_difference, check_difference;
-    
-    while( curr != NULL ){
-        check_difference = curr->size - curr->usage;
-        if( check_difference >= size ){
-            if( worst == NULL){
-                worst = curr;
-                worst_difference = check_difference;
-            } else {
-                /* it is closer than the other value */
-                if( check_difference > worst_difference){
-                    worst = curr;
-                    worst_difference = check_difference;
-                }
-            }
-        }
-        curr = curr->next;
-    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
 
-    return worst;
+/**
+ * Takes the lock of a heap. If its previous owner died holding it, the lock
+ * is marked consistent and used on: pheap_split() and pheap_free() only link
+ * a block in once it is complete, so at worst the dead process leaked the
+ * block it was working on.
+ *
+ * @param heap
+ */
+static void pheap_lock(struct pheap *heap)
+{
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) {
+        LOG("\t[!] Owner of heap %p died holding its lock\n", heap->base);
+        pthread_mutex_consistent(&header->lock);
+    }
 }
 
 /**
- * Using the best fit FSM implementation, it reuses free memory in a region
- * by finding the first closest-in-size memory block.
+ * Releases the lock taken by pheap_lock().
  *
- * @param size
+ * @param heap
  */
-void *best_fit(size_t size)
+static void pheap_unlock(struct pheap *heap)
 {
-    LOGP("\t---- BEST_FIT() ----\n");
-    struct mem_block *curr = g_head;
-    struct mem_block *best = NULL;
-    size_t best_difference, check_difference;
-
-    while( curr != NULL ){
-        check_difference = curr->size - curr->usage;
-        if( (curr->usage == 0 && curr->size == size) || (check_difference == size) ){
-            return curr;
-        } else if( check_difference > size ){
-            if( best == NULL){
-                best = curr;
-                best_difference = check_difference;
-            }
-            /* it is closer than the other value */
-            if( check_difference < best_difference && check_difference != best_difference){ //breaks tie
-                best = curr;
-                best_difference = check_difference;
-            }
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    pthread_mutex_unlock(&header->lock);
+}
 
-        }
-        curr = curr->next;
-    }
+/**
+ * Lays out a new heap: the header followed by one free block covering the
+ * rest of it. The magic number is written last, so a process attaching to a
+ * shared heap never sees one that is only half set up.
+ *
+ * @param heap
+ */
+static void pheap_format(struct pheap *heap)
+{
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    uint64_t first = (sizeof(struct pheap_header) + PHEAP_ALIGNMENT - 1)
+        & ~(uint64_t) (PHEAP_ALIGNMENT - 1);
 
-    if( best == NULL ){
-        return NULL;
-    }
+    struct pheap_block *block = pheap_block_at(heap, first);
+    block->size = heap->size - first;
+    block->usage = 0;
+    block->next = 0;
+    block->magic = PHEAP_BLOCK_MAGIC;
 
-    return best;
+    header->size = heap->size;
+    header->root = 0;
+    header->first = first;
+    pheap_lock_init(header);
+    __atomic_store_n(&header->magic, PHEAP_MAGIC, __ATOMIC_RELEASE);
 }
 
 /**
- * Using free space management (FSM) algorithms, it finds a block of
- * memory that we can reuse. It returns NULL if no suitable block is found.
+ * Maps the heap stored in fd and sets up a handle for it. If fresh, the
+ * object is first sized to hold a new heap of size bytes (rounded up to whole
+ * pages), which is then formatted; otherwise the heap already in it is
+ * checked and size is ignored. Returns NULL (with errno set) on failure,
+ * leaving fd open: EAGAIN if the heap is still being created by another
+ * process, EINVAL if fd does not hold a heap.
  *
- * @param size
+ * @param fd, size, fresh
  */
-void *reuse(size_t size)
+static struct pheap *pheap_setup(int fd, size_t size, bool fresh)
 {
-    LOGP("\t\t---- REUSE() ----\n");
+    if (fresh) {
+        if (size == 0 || size > SIZE_MAX - page_sz) {
+            errno = EINVAL;
+            return NULL;
+        }
+        size = region_size_for(size);
+        if (ftruncate(fd, size) == -1) {
+            return NULL;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            return NULL;
+        }
+        size = st.st_size;
+        if (size < sizeof(struct pheap_header)) {
+            /* a shared heap's creator sizes it before anything else */
+            errno = size == 0 ? EAGAIN : EINVAL;
+            return NULL;
+        }
+    }
 
-    /* algo determines which FSM we will be using */
-    char *algo = getenv("ALLOCATOR_ALGORITHM");
-    if (algo == NULL) {
-        algo = "first_fit";
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
     }
 
-    void *ptr = NULL;
-    if (strcmp(algo, "first_fit") == 0) {
-        ptr = first_fit(size);
-    } else if (strcmp(algo, "best_fit") == 0) {
-        ptr = best_fit(size);
-    } else if (strcmp(algo, "worst_fit") == 0) {
-        ptr = worst_fit(size);
-    } else {
+    struct pheap *heap = malloc(sizeof(struct pheap));
+    if (heap == NULL) {
+        munmap(base, size);
+        errno = ENOMEM;
         return NULL;
     }
+    heap->base = base;
+    heap->size = size;
+    heap->fd = fd;
 
-    if(ptr != NULL){
-        ptr = split(ptr, size);
+    if (fresh) {
+        pheap_format(heap);
+        return heap;
     }
 
-    return ptr;
+    struct pheap_header *header = base;
+    uint64_t magic = __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE);
+    if (magic != PHEAP_MAGIC || header->size != size
+            || header->first < sizeof(struct pheap_header)
+            || header->first > size - sizeof(struct pheap_block)) {
+        munmap(base, size);
+        free(heap);
+        errno = magic == 0 ? EAGAIN : EINVAL;
+        return NULL;
+    }
+    return heap;
 }
 
 /**
- * Allocates memory by checking if you can reuse an existing block. 
- * If not, it maps a new memory region.
- * 
- * @param size
+ * Opens the persistent heap stored in the file at path, creating a new heap
+ * of size bytes (rounded up to whole pages) if the file does not exist or is
+ * empty; size is ignored for an existing heap. The file is mapped shared, so
+ * allocations are written straight to it, and locked with flock() so only
+ * one process opens it at a time. Because the blocks refer to each other by
+ * offset, the heap may be mapped at a different address on every open:
+ * objects stored in it must link to each other with pheap_offset() /
+ * pheap_ptr() rather than with raw pointers. Returns NULL (with errno set) if
+ * the file cannot be opened or mapped, is locked by another process
+ * (EWOULDBLOCK) or is not a persistent heap (EINVAL).
+ *
+ * @param path, size
  */
-void *malloc(size_t size)
+struct pheap *pheap_open(const char *path, size_t size)
 {
-    LOGP("\t---- MALLOC() ----\n");
-
-    pthread_mutex_lock(&alloc_mutex);
-    LOGP("\t[🔒] pthread locked\n");
+    LOGP("\t---- PHEAP_OPEN() ----\n");
 
-    if(size <= 0){
-        pthread_mutex_unlock(&alloc_mutex);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
         return NULL;
     }
 
-    size += sizeof(struct mem_block);
-
-    /* resize size to be aligned to 8 bytes */
-    if(size % 8 != 0){
-        size = size + ( 8 - size % 8);
+    struct stat st;
+    struct pheap *heap = NULL;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0) {
+        heap = pheap_setup(fd, size, st.st_size == 0);
+    }
+    if (heap == NULL) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
     }
 
-    /* create the size of the block, which includes the struct 
-     * at the beginning of the block. block_sz represents how 
-     * much of the region is being used (usage) */
-    size_t block_sz = size;
-    /* for every page_sz bytes we need one page, so anything 
-     * less than page_sz bytes should still result in 1 page */
-    size_t num_pages = block_sz / page_sz;
-    if( (block_sz % page_sz) != 0 ){
-        num_pages += 1;
+    if (st.st_size != 0) {
+        /* whoever had it open last is gone, and its lock state with it */
+        pheap_lock_init((struct pheap_header *) heap->base);
     }
-    /* the total size of the region we are storing blocks in 
-     * will be the num_pages * page_sz */
-    size_t region_sz = num_pages * page_sz;
 
-    LOG("\t\tBlock size: %zu bytes\n", block_sz);
-    LOG("\t\tsize: %zu bytes\n", region_sz);
+    LOG("\t[✓] Opened persistent heap %s (%zu bytes) at %p\n", path, heap->size, heap->base);
+    return heap;
+}
 
-    /* this is the very first implementation: 0 regions, 0 blocks */
-    struct mem_block *block = NULL;
-    if(g_head == NULL){
-        LOGP("\t\tThis is the first malloc() call.\n");
+/**
+ * Opens the heap in the POSIX shared memory object called name (see
+ * shm_open(3)), creating it with a new heap of size bytes if it does not
+ * exist yet; size is ignored otherwise. Any number of processes can have a
+ * shared heap open at once, each at its own address, and all of them may
+ * allocate and free in it: a producer can pheap_malloc() a message, fill it
+ * in and pass its pheap_offset() along (through the heap itself, or a pipe or
+ * socket), and a consumer can read it through pheap_ptr() and pheap_free() it
+ * without copying it. The object stays around until it is removed with
+ * shm_unlink(name). Returns NULL (with errno set) on failure; EAGAIN means
+ * another process is still creating the heap, and the call can be retried.
+ *
+ * @param name, size
+ */
+struct pheap *pheap_open_shared(const char *name, size_t size)
+{
+    LOGP("\t---- PHEAP_OPEN_SHARED() ----\n");
 
-        /* CHECK SCRIBBLING */ 
-        char *scribble = getenv("ALLOCATOR_SCRIBBLE");
-        LOG("\t[✍️] Scribble: %s\n", scribble);
-        if( scribble != NULL && atoi(scribble) == 1 ){
-            LOGP("\t[✍️] Scribbling Mode ON\n");
-            is_scribbling = true;
-        }
+    /* only the process that creates the object formats the heap */
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    bool fresh = fd != -1;
+    if (!fresh && errno == EEXIST) {
+        fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    }
+    if (fd == -1) {
+        return NULL;
+    }
 
-        /* requesting space */
-        block = (struct mem_block *) request(region_sz);
-        /* check if region was created */
-        
-        if(block == NULL){
-            perror("request");
-            pthread_mutex_unlock(&alloc_mutex);
-            LOGP("\t[🔑] pthread unlocked\n");
-            return NULL;
+    struct pheap *heap = pheap_setup(fd, size, fresh);
+    if (heap == NULL) {
+        int err = errno;
+        if (fresh) {
+            shm_unlink(name);
         }
+        close(fd);
+        errno = err;
+        return NULL;
+    }
 
-        /* populate the mem_block */
-        populate(block, size, region_sz, block);
-        block->region_size = region_sz;
-        /* set new head */
-        g_head = block;
+    LOG("\t[✓] Opened shared heap %s (%zu bytes) at %p\n", name, heap->size, heap->base);
+    return heap;
+}
 
-        if( is_scribbling ){
-            LOGP("\t[✍️] Trying to scribble 0xAA\n");
-            size_t scrib_sz = block->size - sizeof(struct mem_block);   
-            memset(block + 1, 0xAA, scrib_sz); 
-            is_scribbling = false;
-            LOGP("\t[✍️] Done!\n");
-        }
+/**
+ * Creates a new shared heap of size bytes in an anonymous memory file (see
+ * memfd_create(2)). Other processes reach it through its descriptor
+ * (pheap_fd()): children inherit it across fork(), and unrelated processes
+ * can be sent it over a Unix socket and call pheap_attach_fd(). The memory is
+ * freed once every process has closed the heap. Returns NULL (with errno
+ * set) on failure.
+ *
+ * @param size
+ */
+struct pheap *pheap_create_memfd(size_t size)
+{
+    LOGP("\t---- PHEAP_CREATE_MEMFD() ----\n");
 
-    } else {
-        LOGP("\tChecking for reuse...\n");
+    int fd = memfd_create("pheap", MFD_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
 
-        /* CHECK SCRIBBLING */ 
-        char *scribble = getenv("ALLOCATOR_SCRIBBLE");
-        LOG("\t[✍️] Scribble: %s\n", scribble);
-        if( scribble != NULL && atoi(scribble) == 1 ){
-            LOGP("\t[✍️] Scribbling Mode ON\n");
-            is_scribbling = true;
-        }
+    struct pheap *heap = pheap_setup(fd, size, true);
+    if (heap == NULL) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
 
-        /* we want to see if we can reuse any space */
-        block = (struct mem_block *) reuse(size);
-        /* check if there is any reusable space */
-        if(block == NULL){
-            LOGP("\tCreating new region...\n");
-            /* there is no reusable space so we need to create a new region */
-            block = (struct mem_block *) request(region_sz);
-            
-            /* check if region was created */
-            if(block == NULL){
-                perror("request"); 
-                pthread_mutex_unlock(&alloc_mutex);
-                LOGP("\t[🔑] pthread unlocked\n");
-                return NULL;
-            }
-            /* populate the mem_block */
-            populate(block, size, region_sz, block);
-            block->region_size = region_sz;
-            /* update linked list */
-            struct mem_block *curr = g_head;
-            while(curr->next != NULL){
-                curr = curr->next;
-            }
-            curr->next = block;
-        }
+    LOG("\t[✓] Created shared heap in memfd %d (%zu bytes) at %p\n", fd, heap->size, heap->base);
+    return heap;
+}
 
-        if( is_scribbling ){
-            LOGP("\t[✍️] Trying to scribble 0xAA\n");
-            size_t scrib_sz = block->size - sizeof(struct mem_block);   
-            memset(block + 1, 0xAA, scrib_sz); 
-            is_scribbling = false;
-            LOGP("\t[✍️] Done!\n");
-        }
-    }
+/**
+ * Opens the shared heap behind fd, a descriptor for one made by
+ * pheap_create_memfd() or pheap_open_shared() in some process. The
+ * descriptor is duplicated, so the caller may close its copy. Returns NULL
+ * (with errno set) on failure.
+ *
+ * @param fd
+ */
+struct pheap *pheap_attach_fd(int fd)
+{
+    LOGP("\t---- PHEAP_ATTACH_FD() ----\n");
 
-    /* RETURN POINTER */
-    pthread_mutex_unlock(&alloc_mutex);
-    LOGP("\t[🔑] pthread unlocked\n");
+    int own = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (own == -1) {
+        return NULL;
+    }
 
-    /* returns block + 1 because block is pointing to the struct header not the data... I think */
-    LOGP("\t[✓] Successfully malloc() memory.\n\n");
-    return block + 1;
+    struct pheap *heap = pheap_setup(own, 0, false);
+    if (heap == NULL) {
+        int err = errno;
+        close(own);
+        errno = err;
+        return NULL;
+    }
+
+    LOG("\t[✓] Attached shared heap from fd %d (%zu bytes) at %p\n", fd, heap->size, heap->base);
+    return heap;
 }
 
 /**
- * It is a version of malloc that allows customized memory block names.
+ * Returns the descriptor of the file or memory object a heap lives in, for
+ * handing to another process (see pheap_attach_fd()). It belongs to the heap
+ * and is closed by pheap_close().
  *
- * @param size, name
+ * @param heap
  */
-void *malloc_name(size_t size, char *name)
+int pheap_fd(struct pheap *heap)
 {
-    LOGP("\t---- MALLOC_NAME() ----\n");
-
-    struct mem_block *block = (struct mem_block *) malloc(size) - 1;
-    
-    /* rename the block */
-    sprintf(block->name,"%s", name);
-    LOG("\tName: %s\n", block->name);
-    LOGP("\t[✓] Succesfully malloc_name()\n");
-    
-    return block + 1;
+    return heap->fd;
 }
 
 /**
- * Deallocates/frees memory by resetting a block's usage to 0.
- * If an entire region's block usage is 0, it unmaps the memory region.
+ * Places a need-byte block in the block at offset off of a persistent heap.
+ * A free block is used from its start, and the rest of it becomes a free
+ * block of its own if it is big enough; in a block that is in use, the new
+ * block is carved out of the unused tail, like split() does.
  *
- * @param ptr
+ * @param heap, off, need
  */
-void free(void *ptr)
-{   
-    LOGP("\t---- FREE() ----\n"); 
-    pthread_mutex_lock(&alloc_mutex);
-    LOGP("\t[🔒] pthread locked\n");
+static struct pheap_block *pheap_split(struct pheap *heap, uint64_t off, uint64_t need)
+{
+    struct pheap_block *block = pheap_block_at(heap, off);
+    bool is_free = block->usage == 0;
 
-    if (ptr == NULL) {
-        /* Freeing a NULL pointer does nothing */
-        LOGP("\t[X] NULL ptr was passed.\n");
-        pthread_mutex_unlock(&alloc_mutex);
-        return;
+    if (is_free && block->size - need < sizeof(struct pheap_block) + PHEAP_ALIGNMENT) {
+        /* too little left over for another block */
+        block->usage = need;
+        return block;
     }
 
-    /* set that block's usage to zero */
-    struct mem_block *block = (struct mem_block *) ptr - 1;
-    LOG("\t\tFreeing alloc id: %lu\n", block->alloc_id);
-    block->usage = 0;
-    LOGP("\t\tAfter freeing:\n");
-    print_block(block);
-
-    /* CHECKING FOR EMPTY REGION */-
-
-    /* Cases:
-     * 1. single region (reset head)
-     * 2. multiple regions, free first (reset head)
-     * 3. two regions, free second (connect head region to null)
-     * 4. multiple regions, free middle (connect prev region to next)
-    */
-
-    bool region_empty = true;
-    bool reset_head = false;
+    uint64_t cut = is_free ? need : block->usage;
+    struct pheap_block *tail = pheap_block_at(heap, off + cut);
+    tail->size = block->size - cut;
+    tail->usage = is_free ? 0 : need;
+    tail->next = block->next;
+    tail->magic = PHEAP_BLOCK_MAGIC;
 
-    struct mem_block *start = block->region_start;
-    struct mem_block *curr = start;
-
-    /* if the start is the head, we will have to reset the head */
-    if(start == g_head){
-        reset_head = true;
+    block->size = cut;
+    block->next = off + cut;
+    if (is_free) {
+        block->usage = need;
+        return block;
     }
+    return tail;
+}
 
-    /* loop while the region starts are equal or the curr has reached null (case 1) */
-    while( curr->region_start == start ){
-        /* if a block usage is not 0, the region is not empty */
-        if( curr->usage != 0 ){
-            region_empty = false;
-            break;
-        } else if( curr->next == NULL ){
-            curr = NULL;
-            break;
-        } else {
-            curr = curr->next;
-        }
+/**
+ * Allocates size bytes (16-byte aligned) from a persistent heap, using the
+ * first block with enough free space (see pheap_split()). Returns NULL if
+ * the heap is full.
+ *
+ * @param heap, size
+ */
+void *pheap_malloc(struct pheap *heap, size_t size)
+{
+    if (size > heap->size) {
+        return NULL;
     }
+    uint64_t need = sizeof(struct pheap_block)
+        + ((size + PHEAP_ALIGNMENT - 1) & ~(uint64_t) (PHEAP_ALIGNMENT - 1));
 
-    /* At this point, curr points to either null or the first block of the adjecent region */
-    if( region_empty ){
-        if( reset_head ){
-            LOGP("\tResetting head...\n");
-            /* cases 1 & 2: if the head is being reset, all we have to do is set the head 
-            to curr which could be null or another region, no connecting needed */
-            g_head = curr;
-            size_t empty_size = start->region_size;
-            int ret = munmap(start, empty_size);
-            if( ret == -1 ){
-                perror("munmap");
-                pthread_mutex_unlock(&alloc_mutex);
-                LOGP("\t[🔑] pthread unlocked\n");
-                return;
-            }
-            LOGP("\t[✓] Region has been unmapped\n");
-        } else {
-            /* cases 3 & 4: if the head is not being freed, we need to connect the previous region 
-            to either null (case 3) or the next region (case 4). Either way we have to loop through
-            all previous blocks */
-            struct mem_block *prev = g_head;
-    
-            while(prev->next != start){
-                prev = prev->next;
-            }
-            /* connecting previous region to either null or next block */
-            prev->next = curr;
+    pheap_lock(heap);
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    struct pheap_block *found = NULL;
 
-            size_t empty_size = start->region_size;
-            int ret = munmap((void *)start, empty_size);
-            if(ret == -1){
-                perror("munmap");
-                pthread_mutex_unlock(&alloc_mutex);
-                LOGP("\t[🔑] pthread unlocked\n");
-                return;
-            }
-            LOGP("\t[✓] Region has been unmapped\n");
+    for (uint64_t off = header->first; off != 0; ) {
+        struct pheap_block *block = pheap_block_at(heap, off);
+        if (block->size - block->usage >= need) {
+            found = pheap_split(heap, off, need);
+            break;
         }
+        off = block->next;
     }
-    pthread_mutex_unlock(&alloc_mutex);
-    LOGP("\t[🔑] pthread unlocked\n\n");
-    LOGP("\t[✓] Succesfully free()\n");
+    pheap_unlock(heap);
+
+    return found == NULL ? NULL : found + 1;
 }
 
 /**
- * Allocates initialized memory space.
+ * Frees a block allocated with pheap_malloc(). A free block absorbs the free
+ * blocks that directly follow it, so space freed over many restarts does not
+ * stay fragmented. Pointers that do not belong to the heap, and double frees,
+ * are ignored.
  *
- * @param nmemb, size
+ * @param heap, ptr
  */
-void *calloc(size_t nmemb, size_t size)
+void pheap_free(struct pheap *heap, void *ptr)
 {
-    LOGP("\t---- CALLOC() ----\n");
-
-    LOG("\t\tCalloc request: %zu members of size %zu bytes\n", nmemb, size);
+    if (ptr == NULL) {
+        return;
+    }
 
-    /* malloc with the number of members * size of members */
-    void *ptr = malloc(nmemb * size);
-    /* use memset to initialize everything to 0 */
-    memset(ptr, 0x00, nmemb * size);
+    struct pheap_block *block = (struct pheap_block *) ptr - 1;
+    if ((char *) block < heap->base || (char *) ptr > heap->base + heap->size
+            || block->magic != PHEAP_BLOCK_MAGIC) {
+        LOG("\t[X] %p is not in persistent heap %p\n", ptr, heap);
+        return;
+    }
 
-    /* return the pointer to the callocd memory (region?/block?) */
-    LOG("\t[✓] Successful calloc() memory to %p\n\n", ptr);
-    
-    return ptr;
+    pheap_lock(heap);
+    if (block->usage != 0) {
+        block->usage = 0;
+        while (block->next != 0 && pheap_block_at(heap, block->next)->usage == 0) {
+            struct pheap_block *next = pheap_block_at(heap, block->next);
+            block->next = next->next;
+            block->size += next->size;
+            next->magic = 0;
+        }
+    }
+    pheap_unlock(heap);
 }
 
 /**
- * Resizes a region of memory by creating a new memory block 
- * and copying the old memory into the new memory block.
+ * Returns the offset of ptr (which must point into the heap) from the start
+ * of a persistent heap, or 0 for NULL. Offsets stay valid across restarts.
  *
- * @param ptr, size
+ * @param heap, ptr
  */
-void *realloc(void *ptr, size_t size)
+size_t pheap_offset(struct pheap *heap, void *ptr)
 {
-    LOGP("\t---- REALLOC() -------------------------------\n");
-    pthread_mutex_lock(&alloc_mutex);
-    LOGP("\t[🔒] pthread locked\n");
-
-    size_t check_size = size + sizeof(struct mem_block);
-    if(check_size % 8 != 0){
-        check_size = check_size + ( 8 - check_size % 8);
-    }
+    return ptr == NULL ? 0 : (size_t) ((char *) ptr - heap->base);
+}
 
+/**
+ * Turns an offset from pheap_offset() back into a pointer for the current
+ * mapping of a persistent heap; 0 gives NULL.
+ *
+ * @param heap, offset
+ */
+void *pheap_ptr(struct pheap *heap, size_t offset)
+{
+    return offset == 0 || offset >= heap->size ? NULL : heap->base + offset;
+}
 
-    if( ptr == NULL ){
-        /* If the pointer is NULL, then we simply malloc a new block */
-        pthread_mutex_unlock(&alloc_mutex);
-        LOGP("\t[🔑] pthread unlocked\n");
-        return malloc(size);
-    }
+/**
+ * Returns the root object of a persistent heap: the entry point a restarted
+ * process uses to find its data again. NULL if none has been set.
+ *
+ * @param heap
+ */
+void *pheap_root(struct pheap *heap)
+{
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    return pheap_ptr(heap, __atomic_load_n(&header->root, __ATOMIC_ACQUIRE));
+}
 
-    if( size == 0 ) {
-        /* Realloc to 0 is often the same as freeing the memory block... But the
-         * C standard doesn't require this. We will free the block and return
-         * NULL here. */
-        pthread_mutex_unlock(&alloc_mutex);
-        LOGP("\t[🔑] pthread unlocked\n");
-        free(ptr);
-        return NULL;
-    }
+/**
+ * Makes ptr (an allocation from this heap, or NULL) the root object of a
+ * persistent heap.
+ *
+ * @param heap, ptr
+ */
+void pheap_set_root(struct pheap *heap, void *ptr)
+{
+    struct pheap_header *header = (struct pheap_header *) heap->base;
+    __atomic_store_n(&header->root, pheap_offset(heap, ptr), __ATOMIC_RELEASE);
+}
 
-    struct mem_block* curr = (struct mem_block*)ptr - 1;
-    //if( curr->size >= size)
-    if( curr->size >= check_size ){
-        /* Size provided is too small to realloc */
-        pthread_mutex_unlock(&alloc_mutex);
-        LOGP("\t[🔑] pthread unlocked\n");
-        curr->usage = check_size;
-        return ptr;
-    }
+/**
+ * Writes a persistent heap back to its file. The kernel writes dirty pages
+ * back on its own as well, and they survive the process exiting or crashing;
+ * this only matters for surviving a crash of the whole machine. Returns 0 on
+ * success and -1 (with errno set) on failure.
+ *
+ * @param heap
+ */
+int pheap_sync(struct pheap *heap)
+{
+    return msync(heap->base, heap->size, MS_SYNC);
+}
 
-    /* Time to realloc by malloc-ing new space and free old space.
-     * Then, we will copy the old data into the new space. */
-    pthread_mutex_unlock(&alloc_mutex);
-    LOGP("\t[🔑] pthread unlocked\n");
-    void *new_ptr = malloc(size);
-    if( !new_ptr ){
-        perror("malloc");
-        return NULL;
+/**
+ * Unmaps a persistent or shared heap and closes (and unlocks) its file. A
+ * persistent heap's contents stay in the file for the next pheap_open(); a
+ * shared heap lives on while other processes have it open, or until
+ * shm_unlink() for one made by pheap_open_shared().
+ *
+ * @param heap
+ */
+void pheap_close(struct pheap *heap)
+{
+    if (heap == NULL) {
+        return;
     }
-    memcpy(new_ptr, ptr, curr->usage); 
-    free(ptr); 
 
-    LOG("\t[✓]Successfully realloc() memory to %p\n\n", new_ptr);
-    return new_ptr;
+    LOG("\t[🗑️] Closing heap %p\n", heap->base);
+    munmap(heap->base, heap->size);
+    close(heap->fd);
+    free(heap);
 }
 
 /**
  * Prints out the current memory state, including both the regions and blocks.
  * Entries are printed in order, so there is an implied link from the topmost
  * entry to the next, and so on. It also takes in a file pointer to redirect
- * output as requested. 
+ * output as requested. This is a debugging aid and takes no locks (fprintf()
+ * may call malloc(), which would deadlock on list_lock), so the heap should
+ * be quiet while it runs; otherwise entries, names included, can be caught
+ * mid-update.
  *
  * @param fp
  */
@@ -658,4 +5014,308 @@ void write_memory(FILE* fp){
 void print_memory(void)
 {
     write_memory(stdout);
-}
\ No newline at end of file
+}
+
+/**
+ * Fills in a snapshot of the allocator's counters, adding up every thread's
+ * share (see STAT_ADD()), and walks the heap to total up mapped, used and
+ * reusable space. A thread may be counting meanwhile, so the counters can be
+ * a few events behind.
+ *
+ * @param stats
+ */
+void get_stats(struct alloc_stats *stats)
+{
+    list_lock_exclusive();
+
+    memset(stats, 0, sizeof(struct alloc_stats));
+    stat_merge(stats, &g_stats);
+    struct stat_counters *counters = __atomic_load_n(&g_stat_threads, __ATOMIC_ACQUIRE);
+    while (counters != NULL) {
+        stat_merge(stats, &counters->counts);
+        counters = counters->next;
+    }
+    stats->soft_limit = __atomic_load_n(&soft_limit, __ATOMIC_RELAXED);
+    stats->hard_limit = __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+    stats->regions = 0;
+    stats->mapped_bytes = 0;
+    stats->used_bytes = 0;
+    stats->free_bytes = 0;
+    stats->largest_free = 0;
+
+    struct mem_block *curr = g_head;
+    while (curr != NULL) {
+        if (curr == curr->region_start) {
+            stats->regions++;
+            stats->mapped_bytes += curr->region_size;
+        }
+        size_t free_sz = curr->size - curr->usage;
+        stats->used_bytes += curr->usage;
+        stats->free_bytes += free_sz;
+        if (free_sz > stats->largest_free) {
+            stats->largest_free = free_sz;
+        }
+        curr = curr->next;
+    }
+
+    list_unlock_exclusive();
+}
+
+/**
+ * Prints the allocator statistics to the given file pointer. Fragmentation is
+ * reported as 1 - (largest free run / total free space): 0% means all of the
+ * reusable space is in one piece.
+ *
+ * @param fp
+ */
+void write_stats(FILE *fp)
+{
+    struct alloc_stats stats;
+    get_stats(&stats);
+
+    double avg_steps = stats.searches == 0
+        ? 0.0 : (double) stats.search_steps / stats.searches;
+    double frag = stats.free_bytes == 0
+        ? 0.0 : 1.0 - (double) stats.largest_free / stats.free_bytes;
+    double util = stats.mapped_bytes == 0
+        ? 0.0 : (double) stats.used_bytes / stats.mapped_bytes;
+
+    fprintf(fp, "[STATS] searches: %lu, avg search length: %.2f blocks\n",
+            stats.searches, avg_steps);
+    fprintf(fp, "[STATS] mmap: %lu, munmap: %lu, regions: %zu\n",
+            stats.mmap_calls, stats.munmap_calls, stats.regions);
+    fprintf(fp, "[STATS] mapped: %zu, used: %zu (%.1f%%), free: %zu, "
+            "largest free: %zu, fragmentation: %.1f%%\n",
+            stats.mapped_bytes, stats.used_bytes, util * 100.0,
+            stats.free_bytes, stats.largest_free, frag * 100.0);
+    fprintf(fp, "[STATS] purges: %lu, purged: %zu bytes\n",
+            stats.purge_calls, stats.purged_bytes);
+    fprintf(fp, "[STATS] sampled (guarded) allocations: %lu\n", stats.sampled);
+    fprintf(fp, "[STATS] arenas: %zu bytes mapped\n", stats.arena_bytes);
+    fprintf(fp, "[STATS] streamed (non-temporal) fills/copies: %zu bytes\n",
+            stats.nt_bytes);
+    double accuracy = stats.lifetime_predictions == 0
+        ? 0.0 : (double) stats.lifetime_correct / stats.lifetime_predictions;
+    fprintf(fp, "[STATS] lifetime: long-lived allocations: %lu, "
+            "predictions: %lu, correct: %lu (%.1f%%)\n",
+            stats.long_lived_allocs, stats.lifetime_predictions,
+            stats.lifetime_correct, accuracy * 100.0);
+    fprintf(fp, "[STATS] limits: soft %zu, hard %zu, pressure events: %lu, refused: %lu\n",
+            stats.soft_limit, stats.hard_limit, stats.pressure_events,
+            stats.limit_failures);
+}
+
+/**
+ * Calls write_stats() with a default file pointer to stdout.
+ *
+ * @param void
+ */
+void print_stats(void)
+{
+    write_stats(stdout);
+}
+
+/**
+ * Fills in the usage of up to max malloc_name() tags and returns how many
+ * were written. The global counts are merged with every thread's pending
+ * counts, so live figures are exact; peaks are tracked whenever a thread
+ * folds its counts (every TAG_FLUSH_BYTES) and on every read, so a short
+ * spike smaller than that may not be reflected.
+ *
+ * @param stats, max
+ */
+size_t get_tag_stats(struct tag_stats *stats, size_t max)
+{
+    unsigned int num_tags = __atomic_load_n(&g_num_tags, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+
+    for (unsigned int tag = 1; tag < num_tags && count < max; ++tag) {
+        struct tag_stats *out = &stats[count++];
+        memcpy(out->name, g_tags[tag].name, sizeof(out->name));
+        out->live_bytes = __atomic_load_n(&g_tags[tag].live_bytes, __ATOMIC_RELAXED)
+            + __atomic_load_n(&g_tag_base.bytes[tag], __ATOMIC_RELAXED);
+        out->live_allocs = __atomic_load_n(&g_tag_base.allocs[tag], __ATOMIC_RELAXED);
+        out->total_allocs = __atomic_load_n(&g_tag_base.total[tag], __ATOMIC_RELAXED);
+
+        struct tag_counters *counters =
+            __atomic_load_n(&g_tag_threads, __ATOMIC_ACQUIRE);
+        while (counters != NULL) {
+            out->live_bytes += __atomic_load_n(&counters->bytes[tag], __ATOMIC_RELAXED);
+            out->live_allocs += __atomic_load_n(&counters->allocs[tag], __ATOMIC_RELAXED);
+            out->total_allocs += __atomic_load_n(&counters->total[tag], __ATOMIC_RELAXED);
+            counters = counters->next;
+        }
+
+        tag_raise_peak(tag, out->live_bytes);
+        out->peak_bytes = __atomic_load_n(&g_tags[tag].peak_bytes, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+/**
+ * Prints the per-tag usage report to the given file pointer.
+ *
+ * @param fp
+ */
+void write_tag_stats(FILE *fp)
+{
+    fflush(fp);
+    dump_tags(fileno(fp));
+}
+
+/**
+ * Calls write_tag_stats() with a default file pointer to stdout.
+ *
+ * @param void
+ */
+void print_tag_stats(void)
+{
+    write_tag_stats(stdout);
+}
+
+/**
+ * Fills in the latency percentiles of up to max measured operations and
+ * phases (see enum lat_hist) and returns how many were written. Every
+ * thread's histograms are added up, along with the samples of exited threads;
+ * a thread may be recording meanwhile, so the counts can be a few samples
+ * behind. Returns 0 unless the allocator was built with LATENCY=1.
+ *
+ * @param stats, max
+ */
+size_t get_latency_stats(struct latency_stats *stats, size_t max)
+{
+#if LATENCY
+    size_t count = 0;
+
+    pthread_mutex_lock(&lat_mutex);
+    for (int hist = 0; hist < LAT_COUNT && count < max; ++hist) {
+        unsigned long merged[LAT_BUCKETS] = { 0 };
+        unsigned long samples = 0;
+
+        for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+            merged[i] = g_lat_exited.counts[hist][i];
+        }
+        struct lat_counters *counters = g_lat_threads;
+        while (counters != NULL) {
+            for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+                merged[i] += __atomic_load_n(&counters->counts[hist][i], __ATOMIC_RELAXED);
+            }
+            counters = counters->next;
+        }
+        for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+            samples += merged[i];
+        }
+
+        struct latency_stats *out = &stats[count++];
+        memset(out, 0, sizeof(*out));
+        snprintf(out->name, sizeof(out->name), "%s", lat_names[hist]);
+        out->count = samples;
+
+        /* the smallest bucket that covers each rank */
+        unsigned long ranks[3] = {
+            (samples * 50 + 99) / 100,
+            (samples * 99 + 99) / 100,
+            (samples * 999 + 999) / 1000,
+        };
+        unsigned long *percentiles[3] = { &out->p50_ns, &out->p99_ns, &out->p999_ns };
+        unsigned long seen = 0;
+        for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+            if (merged[i] == 0) {
+                continue;
+            }
+            seen += merged[i];
+            for (int p = 0; p < 3; ++p) {
+                if (*percentiles[p] == 0 && seen >= ranks[p]) {
+                    *percentiles[p] = lat_bucket_max(i);
+                }
+            }
+            out->max_ns = lat_bucket_max(i);
+        }
+    }
+    pthread_mutex_unlock(&lat_mutex);
+    return count;
+#else
+    (void) stats;
+    (void) max;
+    return 0;
+#endif
+}
+
+/**
+ * Writes the latency report to a file descriptor. Like dump_tags(), this
+ * avoids stdio, so it is safe to call at exit.
+ *
+ * @param fd
+ */
+static void dump_latency(int fd)
+{
+    struct latency_stats stats[16];
+    size_t count = get_latency_stats(stats, 16);
+    char line[160];
+    int len;
+
+    if (count == 0) {
+        len = snprintf(line, sizeof(line),
+                "[LATENCY] not compiled in (build with make LATENCY=1)\n");
+        write(fd, line, len);
+        return;
+    }
+
+    len = snprintf(line, sizeof(line), "[LATENCY] %-10s %12s %10s %10s %10s %12s\n",
+            "(ns)", "count", "p50", "p99", "p99.9", "max");
+    write(fd, line, len);
+    for (size_t i = 0; i < count; ++i) {
+        len = snprintf(line, sizeof(line), "[LATENCY] %-10s %12lu %10lu %10lu %10lu %12lu\n",
+                stats[i].name, stats[i].count, stats[i].p50_ns, stats[i].p99_ns,
+                stats[i].p999_ns, stats[i].max_ns);
+        write(fd, line, len);
+    }
+}
+
+/**
+ * Prints the latency report to the given file pointer.
+ *
+ * @param fp
+ */
+void write_latency_stats(FILE *fp)
+{
+    fflush(fp);
+    dump_latency(fileno(fp));
+}
+
+/**
+ * Calls write_latency_stats() with a default file pointer to stdout.
+ *
+ * @param void
+ */
+void print_latency_stats(void)
+{
+    write_latency_stats(stdout);
+}
+
+#if LATENCY
+/**
+ * Writes the latency report to stderr; registered with atexit().
+ *
+ * @param void
+ */
+static void dump_latency_at_exit(void)
+{
+    dump_latency(STDERR_FILENO);
+}
+
+/**
+ * With ALLOCATOR_LATENCY_DUMP=1, arranges for the latency report to be
+ * written to stderr at exit.
+ *
+ * @param void
+ */
+__attribute__((constructor))
+static void latency_init(void)
+{
+    char *dump = getenv("ALLOCATOR_LATENCY_DUMP");
+    if (dump != NULL && atoi(dump) == 1) {
+        atexit(dump_latency_at_exit);
+    }
+}
+#endif
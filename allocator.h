@@ -12,6 +12,10 @@
 
 /* -- Data Structures -- */
 
+struct region_meta;
+struct arena;
+struct pheap;
+
 /**
  * Defines metadata structure for both memory 'regions' and 'blocks.' This
  * structure is prefixed before each allocation's data area.
@@ -44,7 +48,8 @@ struct mem_block {
     /**
      * If this block is the beginning of a mapped memory region, the region_size
      * member indicates the size of the mapping. In subsequent (split) blocks,
-     * this is undefined.
+     * it holds the block's lifetime record when ALLOCATOR_LIFETIME is on, and
+     * is otherwise 0.
      */
     size_t region_size;
 
@@ -52,24 +57,166 @@ struct mem_block {
     struct mem_block *next;
 
     /**
-     * "Padding" to make the total size of this struct 100 bytes. This serves no
-     * purpose other than to make memory address calculations easier. If you
-     * add members to the struct, you should adjust the padding to compensate
-     * and keep the total size at 100 bytes; test cases and tooling will assume
-     * a 100-byte header.
+     * Time (CLOCK_MONOTONIC, in milliseconds) when this block was freed. The
+     * whole pages of free space behind it are purged once they have been free
+     * for longer than the purge decay; 0 means there is nothing to purge.
+     */
+    unsigned long freed_at;
+
+    /**
+     * If this block is the beginning of a mapped memory region, meta points to
+     * the region's packed array of block free-space sizes, which is what the
+     * FSM algorithms search. In subsequent (split) blocks, this is undefined.
+     */
+    struct region_meta *meta;
+
+    /**
+     * Accounting tag of a block allocated with malloc_name(): an index into
+     * the table of interned names (see get_tag_stats()). 0 means untagged.
+     *
+     * This member used up the last of the padding that kept the struct at 100
+     * bytes. Test cases and tooling assume a 100-byte header, so new members
+     * have to replace existing ones.
      */
-    char padding[20];
+    unsigned int tag;
 } __attribute__((packed));
 
+/**
+ * Allocator statistics, filled in by get_stats(). Counters accumulate over
+ * the life of the process; the byte totals describe the heap at the time of
+ * the call.
+ */
+struct alloc_stats {
+    /** Number of reuse() searches performed */
+    unsigned long searches;
+
+    /** Total number of blocks visited by those searches */
+    unsigned long search_steps;
+
+    /** Number of regions mapped with mmap() */
+    unsigned long mmap_calls;
+
+    /** Number of regions returned to the OS with munmap() */
+    unsigned long munmap_calls;
+
+    /** Number of regions currently mapped */
+    size_t regions;
+
+    /** Total size of all mapped regions */
+    size_t mapped_bytes;
+
+    /** Bytes in use, including block headers */
+    size_t used_bytes;
+
+    /** Bytes available for reuse (the sum of size - usage over all blocks) */
+    size_t free_bytes;
+
+    /** Largest single run of reusable space */
+    size_t largest_free;
+
+    /** Number of madvise() calls made to purge free pages */
+    unsigned long purge_calls;
+
+    /** Total bytes handed back to the OS by purging */
+    size_t purged_bytes;
+
+    /** Number of allocations placed in the guarded sample pool */
+    unsigned long sampled;
+
+    /** Total size of the regions currently mapped by arenas */
+    size_t arena_bytes;
+
+    /** Soft and hard limits on mapped bytes (0: none); see malloc_set_limits() */
+    size_t soft_limit;
+    size_t hard_limit;
+
+    /** Number of times a limit was reached and memory was reclaimed */
+    unsigned long pressure_events;
+
+    /** Number of regions not mapped because of the hard limit */
+    unsigned long limit_failures;
+
+    /** Bytes filled or copied with non-temporal stores (see ALLOCATOR_NT_THRESHOLD) */
+    size_t nt_bytes;
+    /** Allocations placed in long-lived regions (see ALLOCATOR_LIFETIME) */
+    unsigned long long_lived_allocs;
+
+    /** Freed blocks whose lifetime class was predicted, and how many were right */
+    unsigned long lifetime_predictions;
+    unsigned long lifetime_correct;
+};
+
+/**
+ * Memory usage of one malloc_name() tag, filled in by get_tag_stats().
+ */
+struct tag_stats {
+    /** The interned block name */
+    char name[32];
+
+    /** Bytes currently allocated under this name (excluding headers) */
+    long live_bytes;
+
+    /** Number of live allocations under this name */
+    long live_allocs;
+
+    /** Total number of allocations ever made under this name */
+    unsigned long total_allocs;
+
+    /** Highest live_bytes observed (see get_tag_stats()) */
+    long peak_bytes;
+};
+
+/**
+ * Latency percentiles of one operation or phase, filled in by
+ * get_latency_stats() when the allocator is built with LATENCY=1. Values are
+ * in nanoseconds and are rounded up to the end of their histogram bucket
+ * (within 12.5%).
+ */
+struct latency_stats {
+    /** What was timed: malloc, free, realloc, lock wait, lock hold, search, mmap, munmap or purge */
+    char name[16];
+
+    /** Number of samples */
+    unsigned long count;
+
+    /** Median */
+    unsigned long p50_ns;
+
+    /** 99th percentile */
+    unsigned long p99_ns;
+
+    /** 99.9th percentile */
+    unsigned long p999_ns;
+
+    /** Longest sample */
+    unsigned long max_ns;
+};
+
+/**
+ * Called when the heap has grown past its soft limit; see
+ * malloc_set_pressure_callback().
+ */
+typedef void (*pressure_callback)(size_t mapped, size_t limit, void *arg);
+
 /* -- Helper functions -- */
 void *split(void *block, size_t size);
 void *reuse(size_t size);
 void *first_fit(size_t size);
 void *worst_fit(size_t size);
 void *best_fit(size_t size);
+void *next_fit(size_t size);
 void write_memory(FILE* fd);
 void print_memory(void);
 void print_block(struct mem_block *block);
+void get_stats(struct alloc_stats *stats);
+void write_stats(FILE *fp);
+void print_stats(void);
+size_t get_tag_stats(struct tag_stats *stats, size_t max);
+void write_tag_stats(FILE *fp);
+void print_tag_stats(void);
+size_t get_latency_stats(struct latency_stats *stats, size_t max);
+void write_latency_stats(FILE *fp);
+void print_latency_stats(void);
 void populate(struct mem_block *block, size_t requested_sz, size_t block_sz, struct mem_block *start);
 
 /* -- C Memory API functions -- */
@@ -77,5 +224,39 @@ void *malloc(size_t size);
 void free(void *ptr);
 void *calloc(size_t nmemb, size_t size);
 void *realloc(void *ptr, size_t size);
+void *malloc_name(size_t size, char *name);
+int malloc_trim(size_t pad);
+size_t malloc_batch(size_t size, size_t n, void **out);
+void free_batch(void **ptrs, size_t n);
+void *aligned_alloc(size_t alignment, size_t size);
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+void *memalign(size_t alignment, size_t size);
+void free_sized(void *ptr, size_t size);
+void free_aligned_sized(void *ptr, size_t alignment, size_t size);
+void malloc_set_limits(size_t soft, size_t hard);
+void malloc_set_pressure_callback(pressure_callback cb, void *arg);
+size_t malloc_cgroup_limit(void);
+
+/* -- Arena API -- */
+struct arena *arena_create(size_t region_sz);
+void *arena_malloc(struct arena *arena, size_t size);
+void *arena_memalign(struct arena *arena, size_t alignment, size_t size);
+void arena_reset(struct arena *arena);
+void arena_destroy(struct arena *arena);
+
+/* -- Persistent heap API -- */
+struct pheap *pheap_open(const char *path, size_t size);
+struct pheap *pheap_open_shared(const char *name, size_t size);
+struct pheap *pheap_create_memfd(size_t size);
+struct pheap *pheap_attach_fd(int fd);
+int pheap_fd(struct pheap *heap);
+void *pheap_malloc(struct pheap *heap, size_t size);
+void pheap_free(struct pheap *heap, void *ptr);
+size_t pheap_offset(struct pheap *heap, void *ptr);
+void *pheap_ptr(struct pheap *heap, size_t offset);
+void *pheap_root(struct pheap *heap);
+void pheap_set_root(struct pheap *heap, void *ptr);
+int pheap_sync(struct pheap *heap);
+void pheap_close(struct pheap *heap);
 
 #endif
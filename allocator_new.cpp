@@ -0,0 +1,171 @@
+/**
+ * @file allocator_new.cpp
+ *
+ * Routes the C++ operator new/delete family (including the C++14 sized and
+ * C++17 aligned forms) to our allocator, so C++ programs run under
+ * LD_PRELOAD use it for every allocation and hand their known sizes to
+ * free_sized() / free_aligned_sized().
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+extern "C" {
+void free_sized(void *ptr, std::size_t size) noexcept;
+void free_aligned_sized(void *ptr, std::size_t alignment, std::size_t size) noexcept;
+}
+
+namespace {
+
+/**
+ * Allocates size bytes (aligned to alignment, if nonzero), calling the
+ * installed new_handler until it succeeds. Throws std::bad_alloc if there is
+ * no handler. Our block headers leave malloc() payloads only 4-byte aligned,
+ * so plain new goes through aligned_alloc() with the alignment C++ promises
+ * it (__STDCPP_DEFAULT_NEW_ALIGNMENT__).
+ *
+ * @param size, alignment
+ */
+void *new_impl(std::size_t size, std::size_t alignment)
+{
+    if (size == 0) {
+        size = 1;
+    }
+
+    for (;;) {
+        void *ptr = std::aligned_alloc(alignment == 0
+                ? __STDCPP_DEFAULT_NEW_ALIGNMENT__ : alignment, size);
+        if (ptr != nullptr) {
+            return ptr;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+/**
+ * Non-throwing variant of new_impl(): returns nullptr on failure.
+ *
+ * @param size, alignment
+ */
+void *new_nothrow(std::size_t size, std::size_t alignment) noexcept
+{
+    try {
+        return new_impl(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+}
+
+/* -- Replaceable allocation functions -- */
+
+void *operator new(std::size_t size)
+{
+    return new_impl(size, 0);
+}
+
+void *operator new[](std::size_t size)
+{
+    return new_impl(size, 0);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    return new_impl(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    return new_impl(size, static_cast<std::size_t>(align));
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+        const std::nothrow_t &) noexcept
+{
+    return new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+        const std::nothrow_t &) noexcept
+{
+    return new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+/* -- Replaceable deallocation functions -- */
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept
+{
+    free_sized(ptr, size == 0 ? 1 : size);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept
+{
+    free_sized(ptr, size == 0 ? 1 : size);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t align) noexcept
+{
+    free_aligned_sized(ptr, static_cast<std::size_t>(align), size == 0 ? 1 : size);
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t align) noexcept
+{
+    free_aligned_sized(ptr, static_cast<std::size_t>(align), size == 0 ? 1 : size);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file arena_resource.hpp
+ *
+ * std::pmr::memory_resource adapter for the arena API, so standard containers
+ * can allocate from an arena:
+ *
+ *     arena_resource arena;
+ *     std::pmr::vector<int> values(&arena);
+ *
+ * Deallocation is a no-op; memory comes back when the resource is reset() or
+ * destroyed, so containers using it must not outlive either.
+ */
+
+#ifndef ARENA_RESOURCE_HPP
+#define ARENA_RESOURCE_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+extern "C" {
+struct arena;
+struct arena *arena_create(std::size_t region_sz);
+void *arena_memalign(struct arena *arena, std::size_t alignment, std::size_t size);
+void arena_reset(struct arena *arena);
+void arena_destroy(struct arena *arena);
+}
+
+class arena_resource : public std::pmr::memory_resource {
+public:
+    /**
+     * Creates the underlying arena (see arena_create()). Throws
+     * std::bad_alloc if it cannot be mapped.
+     *
+     * @param region_sz
+     */
+    explicit arena_resource(std::size_t region_sz = 0)
+        : arena_(arena_create(region_sz))
+    {
+        if (arena_ == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    arena_resource(const arena_resource &) = delete;
+    arena_resource &operator=(const arena_resource &) = delete;
+
+    ~arena_resource() override
+    {
+        arena_destroy(arena_);
+    }
+
+    /**
+     * Releases everything allocated from this resource at once.
+     */
+    void reset() noexcept
+    {
+        arena_reset(arena_);
+    }
+
+    /** The underlying arena, for use with the C API. */
+    struct arena *get() const noexcept
+    {
+        return arena_;
+    }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        void *ptr = arena_memalign(arena_, alignment, bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override
+    {
+        /* released in bulk by reset() or the destructor */
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    struct arena *arena_;
+};
+
+#endif
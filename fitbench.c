@@ -0,0 +1,86 @@
+/**
+ * @file fitbench.c
+ *
+ * Long-running heap workload for comparing the FSM algorithms. A fixed number
+ * of slots are repeatedly freed and reallocated with a mix of small and
+ * medium sizes, and the allocator statistics (search length, regions,
+ * fragmentation) are printed at regular checkpoints.
+ *
+ * The algorithm is selected the same way as under LD_PRELOAD:
+ * ALLOCATOR_ALGORITHM=next_fit ./fitbench [rounds] [slots]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "allocator.h"
+
+/**
+ * Small deterministic PRNG so every algorithm sees the same request stream.
+ *
+ * @param state
+ */
+static uint32_t next_rand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+/**
+ * Picks a request size: mostly small objects with occasional larger ones.
+ *
+ * @param state
+ */
+static size_t pick_size(uint32_t *state)
+{
+    uint32_t r = next_rand(state) % 100;
+    if (r < 70) {
+        return 8 + next_rand(state) % 120;
+    } else if (r < 95) {
+        return 128 + next_rand(state) % 896;
+    }
+    return 1024 + next_rand(state) % 7168;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    size_t slots = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000;
+    const char *algo = getenv("ALLOCATOR_ALGORITHM");
+    uint32_t seed = 326;
+
+    void **ptrs = calloc(slots, sizeof(void *));
+    if (ptrs == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    printf("-- %s: %lu rounds over %zu slots --\n",
+            algo == NULL ? "first_fit" : algo, rounds, slots);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned long i = 1; i <= rounds; ++i) {
+        size_t slot = next_rand(&seed) % slots;
+        free(ptrs[slot]);
+        ptrs[slot] = malloc(pick_size(&seed));
+
+        if (i % (rounds / 4 == 0 ? 1 : rounds / 4) == 0) {
+            printf("after %lu rounds:\n", i);
+            print_stats();
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("elapsed: %.3f s\n", (end.tv_sec - start.tv_sec)
+            + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    for (size_t i = 0; i < slots; ++i) {
+        free(ptrs[i]);
+    }
+    free(ptrs);
+    return 0;
+}
@@ -0,0 +1,408 @@
+/**
+ * @file mdriver.c
+ *
+ * Scoring driver for the mm_* heap in Storing.c. Each trace file is replayed
+ * against mm_init/mm_malloc/mm_free/mm_realloc three times:
+ *
+ * (1) a correctness pass that checks alignment, heap bounds, overlap and
+ *     payload contents,
+ * (2) a utilization pass that records the peak number of live payload bytes
+ *     relative to the final heap size, and
+ * (3) a timed pass (repeated) that reports operations per second.
+ *
+ * Trace format (same as the CS:APP malloc lab):
+ *
+ *     <suggested heap size>
+ *     <number of ids>
+ *     <number of operations>
+ *     <weight>
+ *     a <id> <bytes>      allocate
+ *     r <id> <bytes>      reallocate
+ *     f <id>              free
+ *
+ * Usage: ./mdriver [-v] [-n iterations] trace.rep [trace.rep ...]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define ALIGNMENT 8
+
+/** Operation kinds found in a trace file. */
+enum trace_op_kind { OP_ALLOC, OP_FREE, OP_REALLOC };
+
+/** A single trace operation. */
+struct trace_op {
+    enum trace_op_kind kind;
+    int id;
+    size_t size;
+};
+
+/** A parsed trace file. */
+struct trace {
+    const char *path;
+    int num_ids;
+    int num_ops;
+    struct trace_op *ops;
+};
+
+/** Per-trace results. */
+struct trace_stats {
+    bool valid;
+    double util;
+    double secs;
+    int ops;
+};
+
+static bool verbose = false;
+
+/**
+ * Reads a trace file into memory. Returns false (and prints why) if the file
+ * cannot be parsed.
+ *
+ * @param path, trace
+ */
+static bool read_trace(const char *path, struct trace *trace)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+
+    int heap_sz, weight;
+    if (fscanf(fp, "%d %d %d %d", &heap_sz, &trace->num_ids, &trace->num_ops,
+                &weight) != 4 || trace->num_ids <= 0 || trace->num_ops < 0) {
+        fprintf(stderr, "%s: malformed trace header\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    trace->path = path;
+    trace->ops = calloc(trace->num_ops, sizeof(struct trace_op));
+
+    char kind[2];
+    int i;
+    for (i = 0; i < trace->num_ops && fscanf(fp, "%1s", kind) == 1; ++i) {
+        struct trace_op *op = &trace->ops[i];
+        if (kind[0] == 'a' || kind[0] == 'r') {
+            op->kind = kind[0] == 'a' ? OP_ALLOC : OP_REALLOC;
+            if (fscanf(fp, "%d %zu", &op->id, &op->size) != 2) {
+                break;
+            }
+        } else if (kind[0] == 'f') {
+            op->kind = OP_FREE;
+            if (fscanf(fp, "%d", &op->id) != 1) {
+                break;
+            }
+        } else {
+            break;
+        }
+
+        if (op->id < 0 || op->id >= trace->num_ids) {
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (i != trace->num_ops) {
+        fprintf(stderr, "%s: malformed operation %d\n", path, i);
+        free(trace->ops);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Checks that a new payload is aligned, lies within the heap and does not
+ * overlap any other live payload.
+ *
+ * @param trace, op_index, ptrs, sizes, id
+ */
+static bool check_block(struct trace *trace, int op_index, char **ptrs,
+        size_t *sizes, int id)
+{
+    char *lo = ptrs[id];
+    char *hi = lo + sizes[id] - 1;
+
+    if ((uintptr_t) lo % ALIGNMENT != 0) {
+        fprintf(stderr, "%s: op %d: payload %p is not %d-byte aligned\n",
+                trace->path, op_index, lo, ALIGNMENT);
+        return false;
+    }
+
+    if (lo < (char *) mem_heap_lo() || hi > (char *) mem_heap_hi()) {
+        fprintf(stderr, "%s: op %d: payload [%p, %p] lies outside the heap\n",
+                trace->path, op_index, lo, hi);
+        return false;
+    }
+
+    for (int i = 0; i < trace->num_ids; ++i) {
+        if (i == id || ptrs[i] == NULL) {
+            continue;
+        }
+        char *other_hi = ptrs[i] + sizes[i] - 1;
+        if (lo <= other_hi && ptrs[i] <= hi) {
+            fprintf(stderr, "%s: op %d: payload %d overlaps payload %d\n",
+                    trace->path, op_index, id, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Verifies that the first len bytes of a payload still hold its id pattern.
+ *
+ * @param ptr, len, id
+ */
+static bool check_pattern(const char *ptr, size_t len, int id)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (ptr[i] != (char) id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Replays a trace with full checking and records peak utilization. Returns
+ * false if the heap misbehaves.
+ *
+ * @param trace, stats
+ */
+static bool eval_trace(struct trace *trace, struct trace_stats *stats)
+{
+    char **ptrs = calloc(trace->num_ids, sizeof(char *));
+    size_t *sizes = calloc(trace->num_ids, sizeof(size_t));
+    size_t live = 0, peak = 0;
+    bool ok = true;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "%s: mm_init failed\n", trace->path);
+        ok = false;
+    }
+
+    for (int i = 0; ok && i < trace->num_ops; ++i) {
+        struct trace_op *op = &trace->ops[i];
+        char *p;
+
+        switch (op->kind) {
+        case OP_ALLOC:
+            if ((p = mm_malloc(op->size)) == NULL && op->size != 0) {
+                fprintf(stderr, "%s: op %d: mm_malloc failed\n",
+                        trace->path, i);
+                ok = false;
+                break;
+            }
+            ptrs[op->id] = p;
+            sizes[op->id] = op->size;
+            if (p != NULL) {
+                ok = check_block(trace, i, ptrs, sizes, op->id);
+                memset(p, op->id, op->size);
+            }
+            live += op->size;
+            break;
+
+        case OP_REALLOC: {
+            size_t old_size = sizes[op->id];
+            if ((p = mm_realloc(ptrs[op->id], op->size)) == NULL
+                    && op->size != 0) {
+                fprintf(stderr, "%s: op %d: mm_realloc failed\n",
+                        trace->path, i);
+                ok = false;
+                break;
+            }
+            size_t kept = old_size < op->size ? old_size : op->size;
+            if (p != NULL && !check_pattern(p, kept, op->id)) {
+                fprintf(stderr, "%s: op %d: mm_realloc lost payload data\n",
+                        trace->path, i);
+                ok = false;
+                break;
+            }
+            ptrs[op->id] = p;
+            sizes[op->id] = op->size;
+            if (p != NULL) {
+                ok = check_block(trace, i, ptrs, sizes, op->id);
+                memset(p, op->id, op->size);
+            }
+            live = live - old_size + op->size;
+            break;
+        }
+
+        case OP_FREE:
+            if (ptrs[op->id] != NULL
+                    && !check_pattern(ptrs[op->id], sizes[op->id], op->id)) {
+                fprintf(stderr, "%s: op %d: payload %d was overwritten\n",
+                        trace->path, i, op->id);
+                ok = false;
+                break;
+            }
+            mm_free(ptrs[op->id]);
+            live -= sizes[op->id];
+            ptrs[op->id] = NULL;
+            sizes[op->id] = 0;
+            break;
+        }
+
+        if (live > peak) {
+            peak = live;
+        }
+    }
+
+    stats->util = mem_heapsize() == 0 ? 0.0 : (double) peak / mem_heapsize();
+
+    free(ptrs);
+    free(sizes);
+    return ok;
+}
+
+/**
+ * Replays a trace without any checking; this is the part that gets timed.
+ *
+ * @param trace, ptrs
+ */
+static void replay_trace(struct trace *trace, char **ptrs)
+{
+    mem_reset_brk();
+    mm_init();
+
+    for (int i = 0; i < trace->num_ops; ++i) {
+        struct trace_op *op = &trace->ops[i];
+        switch (op->kind) {
+        case OP_ALLOC:
+            ptrs[op->id] = mm_malloc(op->size);
+            break;
+        case OP_REALLOC:
+            ptrs[op->id] = mm_realloc(ptrs[op->id], op->size);
+            break;
+        case OP_FREE:
+            mm_free(ptrs[op->id]);
+            ptrs[op->id] = NULL;
+            break;
+        }
+    }
+}
+
+/**
+ * Returns the current monotonic time in seconds.
+ *
+ * @param void
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Prints usage information.
+ *
+ * @param prog
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-v] [-n iterations] trace.rep ...\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 10;
+    int c;
+
+    while ((c = getopt(argc, argv, "vn:h")) != -1) {
+        switch (c) {
+        case 'v':
+            verbose = true;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations <= 0) {
+                iterations = 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mem_init();
+
+    printf("Team: %s (%s)\n", team.name1, team.id1);
+    printf("%-28s %6s %9s %9s %8s %12s\n",
+            "trace", "valid", "util", "ops", "secs", "Kops/s");
+
+    double total_util = 0.0, total_secs = 0.0;
+    long total_ops = 0;
+    int num_traces = 0, num_valid = 0;
+
+    for (int i = optind; i < argc; ++i) {
+        struct trace trace;
+        struct trace_stats stats = { 0 };
+
+        if (!read_trace(argv[i], &trace)) {
+            continue;
+        }
+        num_traces++;
+
+        stats.valid = eval_trace(&trace, &stats);
+        stats.ops = trace.num_ops;
+        if (stats.valid) {
+            char **ptrs = calloc(trace.num_ids, sizeof(char *));
+            double start = now();
+            for (int j = 0; j < iterations; ++j) {
+                replay_trace(&trace, ptrs);
+            }
+            stats.secs = (now() - start) / iterations;
+            free(ptrs);
+
+            num_valid++;
+            total_util += stats.util;
+            total_secs += stats.secs;
+            total_ops += stats.ops;
+        }
+
+        const char *name = strrchr(trace.path, '/');
+        name = name == NULL ? trace.path : name + 1;
+        if (stats.valid) {
+            printf("%-28s %6s %8.1f%% %9d %8.6f %12.0f\n", name, "yes",
+                    stats.util * 100.0, stats.ops, stats.secs,
+                    stats.secs > 0 ? stats.ops / stats.secs / 1e3 : 0.0);
+        } else {
+            printf("%-28s %6s %9s %9d %8s %12s\n", name, "no",
+                    "-", stats.ops, "-", "-");
+        }
+        if (verbose) {
+            printf("    heap: %zu bytes\n", mem_heapsize());
+        }
+
+        free(trace.ops);
+    }
+
+    if (num_valid > 0) {
+        printf("%-28s %6s %8.1f%% %9ld %8.6f %12.0f\n", "Total",
+                num_valid == num_traces ? "yes" : "no",
+                total_util / num_valid * 100.0, total_ops, total_secs,
+                total_secs > 0 ? total_ops / total_secs / 1e3 : 0.0);
+    }
+
+    mem_deinit();
+    return num_valid == num_traces ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file memlib.c
+ *
+ * Stand-in for the memlib package that Storing.c is written against. Instead
+ * of the real sbrk(), the heap is carved out of one large mmap() reservation
+ * so the mm_* functions can be exercised (and measured) in isolation.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memlib.h"
+
+static char *mem_start_brk = NULL; /*!< First byte of the heap */
+static char *mem_brk = NULL;       /*!< Last byte of the heap plus 1 */
+static char *mem_max_addr = NULL;  /*!< Maximum legal heap address plus 1 */
+
+/**
+ * Reserves the address space that backs the simulated heap. MAP_NORESERVE
+ * keeps the reservation cheap: pages are only backed once they are touched.
+ *
+ * @param void
+ */
+void mem_init(void)
+{
+    void *heap = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    mem_start_brk = heap;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    mem_brk = mem_start_brk;
+}
+
+/**
+ * Releases the heap reservation.
+ *
+ * @param void
+ */
+void mem_deinit(void)
+{
+    if (mem_start_brk != NULL) {
+        munmap(mem_start_brk, MAX_HEAP);
+    }
+    mem_start_brk = mem_brk = mem_max_addr = NULL;
+}
+
+/**
+ * Resets the break to the start of the heap, making the heap empty again.
+ * The pages are handed back to the OS so each run starts from a cold heap.
+ *
+ * @param void
+ */
+void mem_reset_brk(void)
+{
+    madvise(mem_start_brk, mem_brk - mem_start_brk, MADV_DONTNEED);
+    mem_brk = mem_start_brk;
+}
+
+/**
+ * Extends the heap by incr bytes and returns the start of the new area. The
+ * heap cannot be shrunk; (void *) -1 is returned on failure, like sbrk().
+ *
+ * @param incr
+ */
+void *mem_sbrk(int incr)
+{
+    char *old_brk = mem_brk;
+
+    if (incr < 0 || incr > mem_max_addr - mem_brk) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *) -1;
+    }
+    mem_brk += incr;
+    return (void *) old_brk;
+}
+
+/**
+ * Returns the address of the first heap byte.
+ *
+ * @param void
+ */
+void *mem_heap_lo(void)
+{
+    return (void *) mem_start_brk;
+}
+
+/**
+ * Returns the address of the last heap byte.
+ *
+ * @param void
+ */
+void *mem_heap_hi(void)
+{
+    return (void *) (mem_brk - 1);
+}
+
+/**
+ * Returns the heap size in bytes.
+ *
+ * @param void
+ */
+size_t mem_heapsize(void)
+{
+    return (size_t) (mem_brk - mem_start_brk);
+}
+
+/**
+ * Returns the system's page size.
+ *
+ * @param void
+ */
+size_t mem_pagesize(void)
+{
+    return (size_t) getpagesize();
+}
@@ -0,0 +1,26 @@
+/**
+ * @file memlib.h
+ *
+ * A simulated memory system for the mm_* heap in Storing.c. The "heap" is a
+ * single large mmap() reservation that mem_sbrk() hands out incrementally,
+ * mirroring how sbrk() grows a process' data segment.
+ */
+
+#ifndef MEMLIB_H
+#define MEMLIB_H
+
+#include <stddef.h>
+
+/** Size of the mmap() reservation backing the simulated heap (64 MiB). */
+#define MAX_HEAP (64 * (1 << 20))
+
+void mem_init(void);
+void mem_deinit(void);
+void *mem_sbrk(int incr);
+void mem_reset_brk(void);
+void *mem_heap_lo(void);
+void *mem_heap_hi(void);
+size_t mem_heapsize(void);
+size_t mem_pagesize(void);
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file mm.h
+ *
+ * Interface for the mm_* heap implemented in Storing.c.
+ */
+
+#ifndef MM_H
+#define MM_H
+
+#include <stdio.h>
+
+int mm_init(void);
+void *mm_malloc(size_t size);
+void mm_free(void *ptr);
+void *mm_realloc(void *ptr, size_t size);
+
+/**
+ * Identifies the authors of the mm_* implementation.
+ */
+typedef struct {
+    char *teamname; /* ID1+ID2 or ID1 */
+    char *name1;    /* full name of first member */
+    char *id1;      /* login ID of first member */
+    char *name2;    /* full name of second member (if any) */
+    char *id2;      /* login ID of second member */
+} team_t;
+
+extern team_t team;
+
+#endif
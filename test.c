@@ -1,59 +1,736 @@
 /**
  * @file test.c
  *
- * A test driver.
+ * Behavior checks for the allocator's extensions, run by `make check` (and
+ * `make test`). Each check runs in a fresh process, re-executed with its own
+ * environment, since the allocator reads its configuration only once. Run
+ * `./checks <name>...` to run only some of them.
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include "logger.h"
 #include "allocator.h"
 
+/** Fails the running check (returning 1 from it) if cond is false. */
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "\t%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 1; \
+		} \
+	} while (0)
 
 /**
- * A test driver.
+ * One behavior check: a name to run it by, the environment it needs, and a
+ * body that returns 0 if it passed.
+ */
+struct check {
+	const char *name;
+	const char *env[4]; /*!< NAME=value settings, NULL-terminated */
+	int (*run)(void);
+};
+
+/**
+ * Fills a block with a byte derived from its slot, so a later
+ * verify_pattern() notices if someone else wrote over it.
+ *
+ * @param ptr, size, slot
+ */
+static void fill_pattern(char *ptr, size_t size, int slot)
+{
+	memset(ptr, 'A' + slot % 26, size);
+}
+
+/**
+ * Returns true if a block still holds what fill_pattern() wrote.
+ *
+ * @param ptr, size, slot
+ */
+static bool verify_pattern(const char *ptr, size_t size, int slot)
+{
+	for (size_t i = 0; i < size; ++i) {
+		if (ptr[i] != 'A' + slot % 26) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Runs body in a child process, with its stderr discarded, and returns true
+ * if the child was killed by signal sig.
+ *
+ * @param body, sig
+ */
+static bool dies_with(void (*body)(void), int sig)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDERR_FILENO);
+		body();
+		_exit(0);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	return WIFSIGNALED(status) && WTERMSIG(status) == sig;
+}
+
+/**
+ * next_fit resumes its search at a rover into the heap. Freeing every block
+ * of a region unmaps the region (a real munmap() with ALLOCATOR_RESERVE=0),
+ * so the rover must never be left pointing into it.
+ *
+ * @param void
+ */
+static int check_next_fit_rover(void)
+{
+	char *ptrs[64] = { 0 };
+	size_t sizes[64] = { 0 };
+	unsigned int seed = 1;
+	struct alloc_stats before, after;
+
+	/* nothing is allocated yet, so the big block's region is the head of
+	the list, and the small one is carved from its tail: the rover now points
+	into a region that the two frees unmap */
+	char *big = malloc(300000);
+	char *small = malloc(16);
+	CHECK(big != NULL && small != NULL);
+	free(small);
+	free(big);
+	small = malloc(16);
+	CHECK(small != NULL);
+	free(small);
+
+	get_stats(&before);
+	for (int round = 0; round < 20000; ++round) {
+		int i = rand_r(&seed) % 64;
+		if (ptrs[i] != NULL) {
+			CHECK(verify_pattern(ptrs[i], sizes[i], i));
+			free(ptrs[i]);
+		}
+		/* every fourth block is big enough for a region of its own */
+		sizes[i] = rand_r(&seed) % 4 == 0
+			? 200000 + rand_r(&seed) % 100000 : 1 + rand_r(&seed) % 2000;
+		ptrs[i] = malloc(sizes[i]);
+		CHECK(ptrs[i] != NULL);
+		fill_pattern(ptrs[i], sizes[i], i);
+	}
+	for (int i = 0; i < 64; ++i) {
+		CHECK(verify_pattern(ptrs[i], sizes[i], i));
+		free(ptrs[i]);
+	}
+
+	get_stats(&after);
+	CHECK(after.munmap_calls > before.munmap_calls);
+	CHECK(after.used_bytes == before.used_bytes);
+	return 0;
+}
+
+/**
+ * malloc_batch() carves a batch out of as few regions as it can, and
+ * free_batch() checks the regions it emptied in one pass at the end. A
+ * region must be unmapped once all of its blocks are gone, however they were
+ * freed, and must stay mapped while one of them is still live.
+ *
+ * @param void
+ */
+static int check_batch_regions(void)
+{
+	enum { N = 2000, SIZE = 700 };
+	static void *ptrs[N];
+	struct alloc_stats before, stats;
+
+	get_stats(&before);
+	CHECK(malloc_batch(SIZE, N, ptrs) == N);
+	for (int i = 0; i < N; ++i) {
+		fill_pattern(ptrs[i], SIZE, i);
+	}
+	for (int i = 0; i < N; ++i) {
+		CHECK(verify_pattern(ptrs[i], SIZE, i));
+	}
+	get_stats(&stats);
+	CHECK(stats.regions > before.regions);
+
+	/* free the blocks in two batches, in random order and keeping one of them
+	live: its region stays */
+	unsigned int seed = 29;
+	for (int i = N - 1; i > 0; --i) {
+		int j = rand_r(&seed) % (i + 1);
+		void *tmp = ptrs[i];
+		ptrs[i] = ptrs[j];
+		ptrs[j] = tmp;
+	}
+	void *live = ptrs[0];
+	ptrs[0] = NULL;
+	free_batch(ptrs, N / 2);
+	free_batch(ptrs + N / 2, N / 2);
+	get_stats(&stats);
+	CHECK(stats.regions > before.regions);
+	CHECK(stats.used_bytes == before.used_bytes + SIZE + sizeof(struct mem_block));
+
+	/* the last block goes through plain free() */
+	free(live);
+	get_stats(&stats);
+	CHECK(stats.regions == before.regions);
+	CHECK(stats.used_bytes == before.used_bytes);
+	CHECK(stats.munmap_calls > before.munmap_calls);
+
+	/* a second batch reuses the heap, and freeing it empties the heap again */
+	CHECK(malloc_batch(SIZE, N, ptrs) == N);
+	for (int i = 0; i < N; ++i) {
+		fill_pattern(ptrs[i], SIZE, i);
+	}
+	for (int i = 0; i < N; ++i) {
+		CHECK(verify_pattern(ptrs[i], SIZE, i));
+	}
+	free_batch(ptrs, N);
+	get_stats(&stats);
+	CHECK(stats.regions == before.regions);
+	CHECK(stats.used_bytes == before.used_bytes);
+	return 0;
+}
+
+/**
+ * The bodies of check_free_sized() that must abort. A block stays live in
+ * each region, so a freed block's header is still mapped when it is checked.
+ *
+ * @param void
+ */
+static void free_sized_short(void)
+{
+	char *keep = malloc(16);
+	free_sized(malloc(100), 50);
+	free(keep);
+}
+
+static void free_sized_twice(void)
+{
+	char *keep = malloc(16);
+	char *ptr = malloc(100);
+	free_sized(ptr, 100);
+	free_sized(ptr, 100);
+	free(keep);
+}
+
+static void free_aligned_sized_long(void)
+{
+	char *keep = malloc(16);
+	free_aligned_sized(aligned_alloc(64, 256), 64, 320);
+	free(keep);
+}
+
+/**
+ * With ALLOCATOR_DEBUG=1, free_sized() and free_aligned_sized() check the
+ * size (and alignment) they are given against the block and abort on a
+ * mismatch or a double free. Matching sizes from every way of allocating a
+ * block must pass.
+ *
+ * @param void
+ */
+static int check_free_sized(void)
+{
+	char *ptr = malloc(100);
+	free_sized(ptr, 100);
+	ptr = calloc(10, 10);
+	free_sized(ptr, 100);
+	ptr = realloc(malloc(10), 5000);
+	free_sized(ptr, 5000);
+	ptr = aligned_alloc(64, 256);
+	CHECK((uintptr_t) ptr % 64 == 0);
+	free_aligned_sized(ptr, 64, 256);
+	void *aligned;
+	CHECK(posix_memalign(&aligned, 4096, 100) == 0);
+	free_aligned_sized(aligned, 4096, 100);
+
+	CHECK(dies_with(free_sized_short, SIGABRT));
+	CHECK(dies_with(free_sized_twice, SIGABRT));
+	CHECK(dies_with(free_aligned_sized_long, SIGABRT));
+	return 0;
+}
+
+/**
+ * Returns a block of size bytes that was placed in the guarded sample pool.
+ * Sampling picks allocations at random intervals, so this allocates until the
+ * sample count goes up; the blocks that were not sampled are leaked.
+ *
+ * @param size
+ */
+static char *sampled_malloc(size_t size)
+{
+	struct alloc_stats before, after;
+	for (int i = 0; i < 1000; ++i) {
+		get_stats(&before);
+		char *ptr = malloc(size);
+		get_stats(&after);
+		if (after.sampled > before.sampled) {
+			return ptr;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * The bodies of check_guarded() that must fault. The 100-byte payload is
+ * padded to a multiple of 8 together with its header, so its last byte is
+ * right in front of the guard page.
  *
  * @param void
  */
-int main(void){
+static void guarded_overflow(void)
+{
+	volatile char *ptr = sampled_malloc(100);
+	ptr[100] = 1;
+}
 
-	// //test 3
-	// char* str0 = malloc(100);
-	// char* str1 = malloc(100);
-	// char* str2 = malloc(16);
-	// char* str3 = malloc(100);
-	// char* str4 = malloc(100);
-	// free(str1);
-	// free(str3);
-	// char* str5 = malloc(16);
-	// char* str6 = malloc(4096);
+static void guarded_use_after_free(void)
+{
+	volatile char *ptr = sampled_malloc(100);
+	free((char *) ptr);
+	ptr[0] = 1;
+}
 
-	// print_memory();
+/**
+ * With ALLOCATOR_SAMPLE_RATE set, sampled allocations end at a PROT_NONE
+ * guard page and their page is made inaccessible when they are freed, so an
+ * overflow or a use-after-free faults right away.
+ *
+ * @param void
+ */
+static int check_guarded(void)
+{
+	char *ptr = sampled_malloc(100);
+	CHECK(ptr != NULL);
+	fill_pattern(ptr, 100, 0);
+	CHECK(verify_pattern(ptr, 100, 0));
+	free(ptr);
 
-	//char* str1 =
-	// char* str2 = malloc(10);
-	// char* str3 = malloc(5000);
-	// print_memory();
+	CHECK(dies_with(guarded_overflow, SIGSEGV));
+	CHECK(dies_with(guarded_use_after_free, SIGSEGV));
+	return 0;
+}
 
-	// char* str0 = malloc(8);
-	// free(str0);
-	// char* str1 = malloc(120);
-	// char* str2 = malloc(16);
-	// char* str3 = malloc(776);
-	// char* str4 = malloc(112);
-	// char* str5 = malloc(1336);
-	// char* str6 = malloc(216);
-	// char* str7 = malloc(432);
-	// char* mid = malloc(8);
-	// char* str8 = malloc(1);
+/** Blocks left live by tag_worker() threads, freed by check_tags() */
+static char *tag_blocks[16][100];
 
-	// char *str1 = malloc(100);
-	// char *str2 = calloc(17, 16);
+/**
+ * Allocates 100 tagged blocks, frees 40 of them and exits, leaving the other
+ * 60 to the main thread.
+ *
+ * @param arg
+ */
+static void *tag_worker(void *arg)
+{
+	char **blocks = arg;
+	for (int i = 0; i < 100; ++i) {
+		blocks[i] = malloc_name(300, "worker");
+	}
+	for (int i = 0; i < 40; ++i) {
+		free(blocks[i]);
+		blocks[i] = NULL;
+	}
+	return NULL;
+}
 
+/**
+ * Looks up a tag's statistics by name.
+ *
+ * @param name, out
+ */
+static bool find_tag(const char *name, struct tag_stats *out)
+{
+	struct tag_stats stats[16];
+	size_t n = get_tag_stats(stats, 16);
+	for (size_t i = 0; i < n; ++i) {
+		if (strcmp(stats[i].name, name) == 0) {
+			*out = stats[i];
+			return true;
+		}
+	}
+	return false;
+}
 
-	//print memory is allocating memory
-	print_memory();
+/**
+ * Tag counts are kept per thread. When a thread exits, its counters are
+ * handed on to the next thread, so what it counted must still show in
+ * get_tag_stats(), and frees of its blocks from another thread must balance
+ * it out.
+ *
+ * @param void
+ */
+static int check_tags(void)
+{
+	struct tag_stats tag;
+
+	/* four rounds of four threads, so later rounds reuse exited threads' counters */
+	for (int round = 0; round < 4; ++round) {
+		pthread_t threads[4];
+		for (int i = 0; i < 4; ++i) {
+			pthread_create(&threads[i], NULL, tag_worker, tag_blocks[round * 4 + i]);
+		}
+		for (int i = 0; i < 4; ++i) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	CHECK(find_tag("worker", &tag));
+	CHECK(tag.total_allocs == 16 * 100);
+	CHECK(tag.live_allocs == 16 * 60);
+	CHECK(tag.live_bytes == 16 * 60 * 300);
+	CHECK(tag.peak_bytes <= 16 * 100 * 300);
+
+	for (int t = 0; t < 16; ++t) {
+		for (int i = 0; i < 100; ++i) {
+			free(tag_blocks[t][i]);
+		}
+	}
+	CHECK(find_tag("worker", &tag));
+	CHECK(tag.total_allocs == 16 * 100);
+	CHECK(tag.live_allocs == 0);
+	CHECK(tag.live_bytes == 0);
+	return 0;
+}
+
+/**
+ * arena_reset() rewinds an arena to its first region and keeps every region
+ * for reuse, so refilling it maps nothing new; arena_destroy() unmaps them.
+ *
+ * @param void
+ */
+static int check_arena(void)
+{
+	struct alloc_stats before, stats;
+	get_stats(&before);
+
+	struct arena *arena = arena_create(0);
+	CHECK(arena != NULL);
+	char *first = arena_malloc(arena, 100);
+	CHECK(first != NULL && (uintptr_t) first % 16 == 0);
+	for (int i = 0; i < 1000; ++i) {
+		char *ptr = arena_malloc(arena, 1000);
+		CHECK(ptr != NULL);
+		fill_pattern(ptr, 1000, i);
+	}
+	char *aligned = arena_memalign(arena, 4096, 10);
+	CHECK(aligned != NULL && (uintptr_t) aligned % 4096 == 0);
+	get_stats(&stats);
+	size_t arena_bytes = stats.arena_bytes;
+	CHECK(arena_bytes >= 1000 * 1000);
+
+	arena_reset(arena);
+	CHECK(arena_malloc(arena, 100) == first);
+	for (int i = 0; i < 1000; ++i) {
+		CHECK(arena_malloc(arena, 1000) != NULL);
+	}
+	get_stats(&stats);
+	CHECK(stats.arena_bytes == arena_bytes);
+
+	arena_destroy(arena);
+	get_stats(&stats);
+	CHECK(stats.arena_bytes == before.arena_bytes);
+	CHECK(stats.used_bytes == before.used_bytes);
+	return 0;
+}
+
+/** A list node stored in a persistent heap; links are pheap offsets. */
+struct pheap_node {
+	size_t next;
+	int value;
+};
+
+/**
+ * A persistent heap links its blocks by offset, so a list built in it must
+ * survive being closed and reopened at another address. The old address is
+ * kept mapped in between, so the second mapping cannot land on it.
+ *
+ * @param void
+ */
+static int check_pheap_reopen(void)
+{
+	enum { SIZE = 1 << 20 };
+	char path[] = "/tmp/checks-pheap-XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1);
+	close(fd);
+
+	struct pheap *heap = pheap_open(path, SIZE);
+	CHECK(heap != NULL);
+	struct pheap_node *head = NULL;
+	for (int i = 0; i < 100; ++i) {
+		struct pheap_node *node = pheap_malloc(heap, sizeof(*node));
+		CHECK(node != NULL);
+		node->value = i;
+		node->next = pheap_offset(heap, head);
+		head = node;
+	}
+	pheap_set_root(heap, head);
+	char *old_base = (char *) head - pheap_offset(heap, head);
+	pheap_close(heap);
+
+	void *blocker = mmap(old_base, SIZE, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	CHECK(blocker == old_base);
+
+	heap = pheap_open(path, SIZE);
+	CHECK(heap != NULL);
+	head = pheap_root(heap);
+	CHECK(head != NULL);
+	CHECK((char *) head - pheap_offset(heap, head) != old_base);
+	int expected = 99;
+	for (struct pheap_node *node = head; node != NULL; node = pheap_ptr(heap, node->next)) {
+		CHECK(node->value == expected);
+		expected--;
+	}
+	CHECK(expected == -1);
+
+	/* the reopened heap can still allocate and free */
+	char *ptr = pheap_malloc(heap, 1000);
+	CHECK(ptr != NULL);
+	pheap_free(heap, ptr);
+
+	pheap_close(heap);
+	munmap(blocker, SIZE);
+	unlink(path);
+	return 0;
+}
+
+/**
+ * Pressure callback for check_limits(): counts its calls.
+ *
+ * @param mapped, limit, arg
+ */
+static void count_pressure(size_t mapped, size_t limit, void *arg)
+{
+	(void) mapped;
+	(void) limit;
+	++*(int *) arg;
+}
+
+/**
+ * Past the soft limit, allocations still succeed but the pressure callback
+ * is called; a region that would cross the hard limit is not mapped, and
+ * malloc() fails with ENOMEM. Freeing memory makes room again.
+ *
+ * @param void
+ */
+static int check_limits(void)
+{
+	enum { SOFT = 1 << 20, HARD = 4 << 20, SIZE = 256 << 10 };
+	static char *ptrs[64];
+	int pressure = 0;
+	struct alloc_stats stats;
+
+	malloc_set_pressure_callback(count_pressure, &pressure);
+	malloc_set_limits(SOFT, HARD);
+
+	int n = 0;
+	while (n < 64 && (ptrs[n] = malloc(SIZE)) != NULL) {
+		fill_pattern(ptrs[n], SIZE, n);
+		n++;
+	}
+	CHECK(n < 64 && errno == ENOMEM);
+	CHECK(n >= SOFT / SIZE);
+	CHECK(pressure > 0);
+
+	get_stats(&stats);
+	CHECK(stats.soft_limit == SOFT && stats.hard_limit == HARD);
+	CHECK(stats.mapped_bytes <= HARD);
+	CHECK(stats.pressure_events > 0);
+	CHECK(stats.limit_failures > 0);
+
+	for (int i = 0; i < n; ++i) {
+		CHECK(verify_pattern(ptrs[i], SIZE, i));
+	}
+	free(ptrs[0]);
+	ptrs[0] = malloc(SIZE);
+	CHECK(ptrs[0] != NULL);
+	for (int i = 0; i < n; ++i) {
+		free(ptrs[i]);
+	}
+	return 0;
+}
+
+/**
+ * Child side of check_shared_heap(): reads the message at the heap's root,
+ * frees it and answers with a message of its own, whose offset goes back
+ * through the pipe. With attach set, the child maps the heap again through
+ * its descriptor instead of using the mapping inherited across fork().
+ * Returns the child's exit status.
+ *
+ * @param heap, attach, pipe_fd
+ */
+static int shared_heap_child(struct pheap *heap, bool attach, int pipe_fd)
+{
+	if (attach) {
+		heap = pheap_attach_fd(pheap_fd(heap));
+		if (heap == NULL) {
+			return 1;
+		}
+	}
+	char *message = pheap_root(heap);
+	if (message == NULL || strcmp(message, "ping") != 0) {
+		return 2;
+	}
+	pheap_set_root(heap, NULL);
+	pheap_free(heap, message);
+
+	char *reply = pheap_malloc(heap, 64);
+	if (reply == NULL) {
+		return 3;
+	}
+	strcpy(reply, "pong");
+	size_t offset = pheap_offset(heap, reply);
+	return write(pipe_fd, &offset, sizeof(offset)) == sizeof(offset) ? 0 : 4;
+}
+
+/**
+ * A memfd heap is shared with child processes: a message allocated by the
+ * parent is read and freed by a child, and the child's reply is read and
+ * freed by the parent. The first child uses the mapping it inherited across
+ * fork(), the second maps the heap again at its own address.
+ *
+ * @param void
+ */
+static int check_shared_heap(void)
+{
+	struct pheap *heap = pheap_create_memfd(1 << 20);
+	CHECK(heap != NULL);
+
+	for (int attach = 0; attach < 2; ++attach) {
+		int fds[2];
+		CHECK(pipe(fds) == 0);
+		char *message = pheap_malloc(heap, 64);
+		CHECK(message != NULL);
+		strcpy(message, "ping");
+		pheap_set_root(heap, message);
+
+		pid_t pid = fork();
+		CHECK(pid != -1);
+		if (pid == 0) {
+			_exit(shared_heap_child(heap, attach, fds[1]));
+		}
+		int status;
+		waitpid(pid, &status, 0);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+		size_t offset;
+		CHECK(read(fds[0], &offset, sizeof(offset)) == sizeof(offset));
+		close(fds[0]);
+		close(fds[1]);
+		CHECK(pheap_root(heap) == NULL);
+		char *reply = pheap_ptr(heap, offset);
+		CHECK(strcmp(reply, "pong") == 0);
+		pheap_free(heap, reply);
+	}
+
+	/* everything was freed, so the heap has room for most of its size */
+	char *big = pheap_malloc(heap, 1 << 19);
+	CHECK(big != NULL);
+	pheap_free(heap, big);
+	pheap_close(heap);
+	return 0;
+}
+
+static struct check checks[] = {
+	{ "next_fit_rover", { "ALLOCATOR_ALGORITHM=next_fit", "ALLOCATOR_RESERVE=0" },
+		check_next_fit_rover },
+	{ "batch_regions", { NULL }, check_batch_regions },
+	{ "free_sized", { "ALLOCATOR_DEBUG=1" }, check_free_sized },
+	{ "guarded", { "ALLOCATOR_SAMPLE_RATE=1" }, check_guarded },
+	{ "tags", { NULL }, check_tags },
+	{ "arena", { NULL }, check_arena },
+	{ "pheap_reopen", { NULL }, check_pheap_reopen },
+	{ "limits", { NULL }, check_limits },
+	{ "shared_heap", { NULL }, check_shared_heap },
+};
+
+/**
+ * Runs one check in a child process: the test binary itself, re-executed with
+ * the check's environment. Returns true if it passed.
+ *
+ * @param self, check
+ */
+static bool run_check(const char *self, struct check *check)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		return false;
+	}
+	if (pid == 0) {
+		for (int i = 0; check->env[i] != NULL; ++i) {
+			putenv((char *) check->env[i]);
+		}
+		execl(self, self, check->name, (char *) NULL);
+		perror("execl");
+		_exit(127);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	printf("[%s] %s\n", passed ? "PASS" : "FAIL", check->name);
+	return passed;
+}
+
+/**
+ * Looks up a check by name.
+ *
+ * @param name
+ */
+static struct check *find_check(const char *name)
+{
+	for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+		if (strcmp(checks[i].name, name) == 0) {
+			return &checks[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * A test driver. With no arguments, every check is run in its own process;
+ * with names, only those checks are run. A re-executed child is told which
+ * check to run with CHECK_CHILD in its environment.
+ *
+ * @param argc, argv
+ */
+int main(int argc, char *argv[])
+{
+	if (getenv("CHECK_CHILD") != NULL) {
+		struct check *check = find_check(argv[1]);
+		return check == NULL ? 2 : check->run();
+	}
+	putenv("CHECK_CHILD=1");
 
-}
\ No newline at end of file
+	int failed = 0;
+	if (argc < 2) {
+		for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+			failed += !run_check("/proc/self/exe", &checks[i]);
+		}
+	}
+	for (int i = 1; i < argc; ++i) {
+		struct check *check = find_check(argv[i]);
+		if (check == NULL) {
+			fprintf(stderr, "no such check: %s\n", argv[i]);
+			failed++;
+			continue;
+		}
+		failed += !run_check("/proc/self/exe", check);
+	}
+	return failed != 0;
+}
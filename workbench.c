@@ -0,0 +1,445 @@
+/**
+ * @file workbench.c
+ *
+ * Runs real programs under allocator.so and under the system (glibc)
+ * allocator and compares them. Each workload is a shell command; while it
+ * runs, the whole process tree is sampled from /proc for resident memory
+ * (RSS) and the number of memory mappings, and the wall time is measured.
+ *
+ * Every workload is run once with the system allocator and once per
+ * ALLOCATOR_ALGORITHM given on the command line, with allocator.so loaded
+ * through LD_PRELOAD:
+ *
+ *     ./workbench [-n runs] [-i interval_ms] [-w workload,...] allocator.so [algorithm ...]
+ *
+ * Workloads whose program is not installed are skipped.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PROCS 4096
+#define MAX_CONFIGS 16
+
+/** A workload: a shell command run in the scratch directory. */
+struct workload {
+    const char *name;
+    const char *program; /*!< Must be installed for the workload to run */
+    const char *command;
+};
+
+/** Measurements from one run of a workload. */
+struct sample_stats {
+    bool ok;            /*!< The command exited with status 0 */
+    double secs;        /*!< Wall time */
+    long peak_rss_kb;   /*!< Highest total RSS of the process tree */
+    long mean_rss_kb;   /*!< Average total RSS over the samples */
+    long peak_maps;     /*!< Highest total number of mappings */
+};
+
+/*
+ * The scratch directory holds input.txt (generated by make_input()) and
+ * dicts.py; every command runs with it as the working directory.
+ */
+static const struct workload workloads[] = {
+    { "sort", "sort",
+        "sort -S 64M input.txt > sorted.txt" },
+    { "python-dicts", "python3",
+        "python3 dicts.py > /dev/null" },
+    { "gcc", "gcc",
+        "gcc -O2 -c -w -x c gcc-input.c -o gcc-output.o" },
+    { "xz-threads", "xz",
+        "xz -T4 -3 -c input.txt > input.txt.xz" },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static const char *dicts_py =
+    "import random\n"
+    "random.seed(38)\n"
+    "tables = []\n"
+    "for round in range(6):\n"
+    "    table = {}\n"
+    "    for i in range(200000):\n"
+    "        key = 'key-%d-%d' % (round, random.randrange(10**9))\n"
+    "        table[key] = [i, str(i) * (i % 7), {'round': round}]\n"
+    "    tables.append(table)\n"
+    "    if len(tables) > 2:\n"
+    "        tables.pop(0)\n"
+    "print(sum(len(t) for t in tables))\n";
+
+/**
+ * Returns the current monotonic time in seconds.
+ *
+ * @param void
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the input files used by the workloads: about 8 MiB of random text
+ * lines, the Python script, and a C file for gcc (the allocator itself, with
+ * its headers, copied from srcdir; a stub if it cannot be found).
+ *
+ * @param dir, srcdir
+ */
+static bool make_input(const char *dir, const char *srcdir)
+{
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/input.txt", dir);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    unsigned int state = 38;
+    for (int i = 0; i < 150000; ++i) {
+        int len = 20 + i % 60;
+        for (int j = 0; j < len; ++j) {
+            state = state * 1103515245 + 12345;
+            fputc('a' + (state >> 16) % 26, fp);
+        }
+        fputc('\n', fp);
+    }
+    fclose(fp);
+
+    snprintf(path, sizeof(path), "%s/dicts.py", dir);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    fputs(dicts_py, fp);
+    fclose(fp);
+
+    char command[5 * 4096 + 128];
+    snprintf(command, sizeof(command),
+            "(cp '%s/allocator.c' '%s/gcc-input.c' && cp '%s/'*.h '%s') 2>/dev/null "
+            "|| echo 'int main(void) { return 0; }' > '%s/gcc-input.c'",
+            srcdir, dir, srcdir, dir, dir);
+    return system(command) == 0;
+}
+
+/**
+ * Returns true if program can be found on the PATH.
+ *
+ * @param program
+ */
+static bool installed(const char *program)
+{
+    char command[256];
+    snprintf(command, sizeof(command), "command -v %s > /dev/null 2>&1", program);
+    return system(command) == 0;
+}
+
+/**
+ * Reads a process's parent pid from /proc/<pid>/stat. Returns -1 if the
+ * process is gone.
+ *
+ * @param pid
+ */
+static pid_t parent_of(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    /* the command name may contain spaces: skip to the last ')' */
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    char *end = strrchr(buf, ')');
+    int ppid;
+    if (end == NULL || sscanf(end + 1, " %*c %d", &ppid) != 1) {
+        return -1;
+    }
+    return ppid;
+}
+
+/**
+ * Adds a process's RSS (in KiB) and mapping count to the totals.
+ *
+ * @param pid, rss_kb, maps
+ */
+static void add_usage(pid_t pid, long *rss_kb, long *maps)
+{
+    char path[64], line[512];
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            long kb;
+            if (sscanf(line, "VmRSS: %ld kB", &kb) == 1) {
+                *rss_kb += kb;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    fp = fopen(path, "r");
+    if (fp != NULL) {
+        int c;
+        while ((c = fgetc(fp)) != EOF) {
+            if (c == '\n') {
+                (*maps)++;
+            }
+        }
+        fclose(fp);
+    }
+}
+
+/**
+ * Totals the RSS and mappings of root and all of its descendants.
+ *
+ * @param root, rss_kb, maps
+ */
+static void sample_tree(pid_t root, long *rss_kb, long *maps)
+{
+    static pid_t pids[MAX_PROCS], parents[MAX_PROCS];
+    size_t count = 0;
+
+    *rss_kb = 0;
+    *maps = 0;
+
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL && count < MAX_PROCS) {
+        pid_t pid = atoi(entry->d_name);
+        if (pid > 0) {
+            pids[count] = pid;
+            parents[count] = parent_of(pid);
+            count++;
+        }
+    }
+    closedir(proc);
+
+    for (size_t i = 0; i < count; ++i) {
+        /* walk up the parent chain looking for the root */
+        pid_t pid = pids[i];
+        for (int depth = 0; depth < 64 && pid > 1; ++depth) {
+            if (pid == root) {
+                add_usage(pids[i], rss_kb, maps);
+                break;
+            }
+            size_t j;
+            for (j = 0; j < count && pids[j] != pid; ++j) {
+            }
+            pid = j < count ? parents[j] : -1;
+        }
+    }
+}
+
+/**
+ * Runs one workload with the given environment settings and samples it every
+ * interval_ms until it exits. preload and algorithm may be NULL (the system
+ * allocator).
+ *
+ * @param work, dir, preload, algorithm, interval_ms, stats
+ */
+static void run_workload(const struct workload *work, const char *dir,
+        const char *preload, const char *algorithm, long interval_ms,
+        struct sample_stats *stats)
+{
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        stats->ok = false;
+        return;
+    }
+
+    if (pid == 0) {
+        if (chdir(dir) == -1) {
+            perror(dir);
+            _exit(127);
+        }
+        if (preload != NULL) {
+            setenv("LD_PRELOAD", preload, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        if (algorithm != NULL) {
+            setenv("ALLOCATOR_ALGORITHM", algorithm, 1);
+        }
+        execl("/bin/sh", "sh", "-c", work->command, (char *) NULL);
+        _exit(127);
+    }
+
+    long samples = 0, total_rss = 0;
+    int status = 0;
+    struct timespec interval = {
+        interval_ms / 1000, (interval_ms % 1000) * 1000000L
+    };
+
+    memset(stats, 0, sizeof(*stats));
+    for (;;) {
+        long rss_kb, maps;
+        sample_tree(pid, &rss_kb, &maps);
+        if (rss_kb > 0) {
+            samples++;
+            total_rss += rss_kb;
+            if (rss_kb > stats->peak_rss_kb) {
+                stats->peak_rss_kb = rss_kb;
+            }
+            if (maps > stats->peak_maps) {
+                stats->peak_maps = maps;
+            }
+        }
+
+        pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid || (done == -1 && errno != EINTR)) {
+            break;
+        }
+        nanosleep(&interval, NULL);
+    }
+
+    stats->secs = now() - start;
+    stats->mean_rss_kb = samples == 0 ? 0 : total_rss / samples;
+    stats->ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Prints usage information.
+ *
+ * @param prog
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n runs] [-i interval_ms] [-w workload,...] "
+            "allocator.so [algorithm ...]\n", prog);
+    fprintf(stderr, "Workloads:");
+    for (size_t i = 0; i < NUM_WORKLOADS; ++i) {
+        fprintf(stderr, " %s", workloads[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = 1;
+    long interval_ms = 20;
+    const char *selected = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:i:w:h")) != -1) {
+        switch (c) {
+        case 'n':
+            runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'i':
+            interval_ms = atol(optarg) > 0 ? atol(optarg) : 1;
+            break;
+        case 'w':
+            selected = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* LD_PRELOAD needs an absolute path, since the workloads change directory */
+    char *preload = realpath(argv[optind], NULL);
+    if (preload == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    /* config 0 is the system allocator */
+    const char *algorithms[MAX_CONFIGS] = { NULL };
+    int num_configs = 1;
+    for (int i = optind + 1; i < argc && num_configs < MAX_CONFIGS; ++i) {
+        algorithms[num_configs++] = argv[i];
+    }
+    if (num_configs == 1) {
+        algorithms[num_configs++] = "first_fit";
+    }
+
+    char dir[] = "/tmp/workbench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    /* gcc compiles the allocator source that sits next to allocator.so */
+    char srcdir[4096];
+    snprintf(srcdir, sizeof(srcdir), "%s", preload);
+    *strrchr(srcdir, '/') = '\0';
+
+    if (!make_input(dir, srcdir)) {
+        return 1;
+    }
+
+    printf("%-14s %-12s %4s %9s %12s %12s %9s %9s\n", "workload", "allocator",
+            "ok", "secs", "peak RSS kB", "mean RSS kB", "maps", "RSS/glibc");
+
+    for (size_t w = 0; w < NUM_WORKLOADS; ++w) {
+        const struct workload *work = &workloads[w];
+        if (selected != NULL && strstr(selected, work->name) == NULL) {
+            continue;
+        }
+        if (!installed(work->program)) {
+            printf("%-14s (skipped: %s is not installed)\n", work->name, work->program);
+            continue;
+        }
+
+        long glibc_peak = 0;
+        for (int config = 0; config < num_configs; ++config) {
+            struct sample_stats best = { 0 };
+
+            /* keep the fastest successful run; RSS is taken from the same run */
+            for (int run = 0; run < runs; ++run) {
+                struct sample_stats stats;
+                run_workload(work, dir, config == 0 ? NULL : preload,
+                        algorithms[config], interval_ms, &stats);
+                if (run == 0 || (stats.ok && (!best.ok || stats.secs < best.secs))) {
+                    best = stats;
+                }
+            }
+
+            if (config == 0) {
+                glibc_peak = best.peak_rss_kb;
+            }
+            printf("%-14s %-12s %4s %9.3f %12ld %12ld %9ld %8.2fx\n",
+                    work->name, config == 0 ? "glibc" : algorithms[config],
+                    best.ok ? "yes" : "no", best.secs, best.peak_rss_kb,
+                    best.mean_rss_kb, best.peak_maps,
+                    glibc_peak == 0 ? 0.0 : (double) best.peak_rss_kb / glibc_peak);
+            fflush(stdout);
+        }
+    }
+
+    char command[256];
+    snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+    system(command);
+    free(preload);
+    return 0;
+}